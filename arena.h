@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+#define ARENA_HEADER_SIZE ((sizeof(arenaChunkStruct)+ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1))
+
+
+typedef struct arenaChunk{
+    struct arenaChunk *next;
+    size_t size; // usable bytes after the chunk header
+    size_t used;
+}arenaChunkStruct;
+
+typedef struct arena{
+    arenaChunkStruct *chunks; // current chunk first
+    pthread_mutex_t lock; // serializes `arenaAllocShared`
+    size_t allocations; // statistics, printed on release in debug builds
+    size_t requested;
+    size_t reserved;
+    size_t chunkCount;
+}arenaStruct;
+
+
+arenaStruct *arenaCreate(void);
+void arenaFree(arenaStruct *arena);
+void *arenaAlloc(arenaStruct *arena, size_t size);
+void *arenaAllocShared(arenaStruct *arena, size_t size);
+arenaChunkStruct *arenaChunkCreate(size_t size);
+
+
+arenaStruct *arenaCreate(void){
+    /**
+     * Create empty bump allocator
+     * :return: Arena
+     */
+    arenaStruct *arena = malloc(sizeof(arenaStruct));
+    arena->chunks = NULL;
+    pthread_mutex_init(&arena->lock, NULL);
+    arena->allocations = 0;
+    arena->requested = 0;
+    arena->reserved = 0;
+    arena->chunkCount = 0;
+    return arena;
+}
+
+void arenaFree(arenaStruct *arena){
+    /**
+     * Release every allocation of the arena at once
+     * :param arena: Arena
+     * :return: None
+     */
+#ifdef ARENA_DEBUG
+    fprintf(stderr, "Arena: %zu allocations, %zu bytes requested, %zu bytes reserved in %zu chunks\n",
+            arena->allocations, arena->requested, arena->reserved, arena->chunkCount);
+#endif
+    arenaChunkStruct *cur = arena->chunks;
+    while(cur != NULL){
+        arenaChunkStruct *next = cur->next;
+        free(cur);
+        cur = next;
+    }
+    pthread_mutex_destroy(&arena->lock);
+    free(arena);
+}
+
+void *arenaAlloc(arenaStruct *arena, size_t size){
+    /**
+     * Bump allocate from the current chunk
+     * Allocations larger than a chunk get a chunk of their own, kept behind
+     * the current one so its free space is still used
+     * :param arena: Arena
+     * :param size: Bytes to allocate
+     * :return: ARENA_ALIGN aligned memory, valid until `arenaFree`
+     */
+    size = (size+ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+    arena->allocations++;
+    arena->requested += size;
+
+    arenaChunkStruct *chunk = arena->chunks;
+    if(chunk == NULL || chunk->size-chunk->used < size){
+        if(size > ARENA_CHUNK_SIZE/4){ // Large allocation
+            arenaChunkStruct *large = arenaChunkCreate(size);
+            if(chunk == NULL){
+                arena->chunks = large;
+            }else{
+                large->next = chunk->next;
+                chunk->next = large;
+            }
+            large->used = size;
+            arena->reserved += size;
+            arena->chunkCount++;
+            return (char *)large+ARENA_HEADER_SIZE;
+        }
+        chunk = arenaChunkCreate(ARENA_CHUNK_SIZE);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->reserved += ARENA_CHUNK_SIZE;
+        arena->chunkCount++;
+    }
+    void *memory = (char *)chunk+ARENA_HEADER_SIZE+chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+void *arenaAllocShared(arenaStruct *arena, size_t size){
+    /**
+     * Bump allocate from threads sharing the arena
+     * While threads share the arena every allocation must come through here
+     * :param arena: Arena
+     * :param size: Bytes to allocate
+     * :return: ARENA_ALIGN aligned memory, valid until `arenaFree`
+     */
+    pthread_mutex_lock(&arena->lock);
+    void *memory = arenaAlloc(arena, size);
+    pthread_mutex_unlock(&arena->lock);
+    return memory;
+}
+
+arenaChunkStruct *arenaChunkCreate(size_t size){
+    /**
+     * Allocate arena chunk
+     * :param size: Usable bytes
+     * :return: Empty arena chunk
+     */
+    arenaChunkStruct *chunk = malloc(ARENA_HEADER_SIZE+size);
+    if(chunk == NULL){ // Error handling
+        fprintf(stderr, "Error: Cannot allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
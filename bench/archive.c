@@ -0,0 +1,493 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define BENCH_MAX_RUNS 16
+#define BENCH_BATCH 16384 // file operands per command, both tools run the same batches
+#define BENCH_TEXT_SIZE (1 << 20)
+#define BENCH_DELETE_STRIDE 100 // -d removes every 100th member
+#define BENCH_NAME_SIZE 16
+
+
+/* Archive benchmark: generates synthetic datasets, then times myar and
+   GNU ar on each operation with cold and warm page caches. Every
+   measurement is appended as one CSV row to the results file, so runs from
+   different releases can be compared.
+
+       bench/archive [-s quick|full] [-r runs] [-w workdir] [-o results] [myar]
+
+   GNU ar has no -A, so its -A row appends the same files with `ar qc`.
+   Cold runs evict the inputs with fdatasync and POSIX_FADV_DONTNEED first.
+   Warm runs follow one untimed run. */
+
+typedef struct benchDataset{
+    char *name;
+    size_t count; // members
+    long long minSize; // body bytes, sizes are log-uniform between the bounds
+    long long maxSize;
+}benchDatasetStruct;
+
+typedef struct benchResult{
+    double seconds[BENCH_MAX_RUNS]; // wall time of each run
+    double userSeconds; // summed over runs
+    double systemSeconds;
+    long maxRss; // KiB, largest of any run
+}benchResultStruct;
+
+typedef struct bench{
+    char *workdir;
+    char *results;
+    char *release;
+    char *tools[2]; // myar and GNU ar executables
+    int runs;
+    char datadir[4096]; // dataset files
+    char **names; // dataset file names, generation order
+    size_t count;
+    long long bytes; // dataset body bytes
+    char *text; // generator source text
+}benchStruct;
+
+
+benchDatasetStruct benchQuick[] = {
+    {"tiny", 10000, 16, 256},
+    {"mixed", 2000, 64, 8LL << 20},
+    {"large", 2, 256LL << 20, 256LL << 20},
+};
+benchDatasetStruct benchFull[] = {
+    {"tiny", 1000000, 16, 256},
+    {"mixed", 20000, 64, 8LL << 20},
+    {"large", 3, 2LL << 30, 2LL << 30},
+};
+char *benchOperations[] = {"q", "A", "t", "v", "x", "d"};
+
+
+double benchNow(void){
+    /**
+     * Monotonic clock
+     * :return: Seconds
+     */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec+now.tv_nsec/1e9;
+}
+
+long long benchSize(benchDatasetStruct *dataset, size_t i){
+    /**
+     * Deterministic log-uniform body size of dataset file
+     * :param dataset: Dataset
+     * :param i: File position
+     * :return: Body bytes
+     */
+    if(dataset->minSize == dataset->maxSize){
+        return dataset->minSize;
+    }
+    unsigned long long state = (i+1)*0x9e3779b97f4a7c15ULL;
+    state ^= state >> 31;
+    state *= 0xbf58476d1ce4e5b9ULL;
+    state ^= state >> 29;
+    double fraction = (state >> 11)/(double)(1ULL << 53);
+    double logMin = log(dataset->minSize), logMax = log(dataset->maxSize);
+    return (long long)exp(logMin+fraction*(logMax-logMin));
+}
+
+void benchGenerateFile(benchStruct *bench, char *pathname, long long size, size_t seed){
+    /**
+     * Write text file from the generator source text
+     * :param bench: Benchmark state
+     * :param pathname: On-disk file path
+     * :param size: File bytes
+     * :param seed: Start position in the source text
+     * :return: None
+     */
+    int fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){ // Error handling
+        fprintf(stderr, "Error: Cannot create file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    size_t start = seed*7919%BENCH_TEXT_SIZE;
+    while(size > 0){
+        size_t count = BENCH_TEXT_SIZE-start;
+        if((long long)count > size){
+            count = size;
+        }
+        if(write(fd, bench->text+start, count) != (ssize_t)count){ // Error handling
+            fprintf(stderr, "Error: Cannot write to file \"%s\"\n", pathname);
+            exit(EXIT_FAILURE);
+        }
+        size -= count;
+        start = 0;
+    }
+    close(fd);
+}
+
+void benchGenerate(benchStruct *bench, benchDatasetStruct *dataset){
+    /**
+     * Generate dataset files unless an earlier run left them complete
+     * :param bench: Benchmark state
+     * :param dataset: Dataset
+     * :return: None
+     */
+    snprintf(bench->datadir, sizeof(bench->datadir), "%s/%s-%zu", bench->workdir, dataset->name, dataset->count);
+    char marker[4200];
+    snprintf(marker, sizeof(marker), "%s.complete", bench->datadir);
+    int isComplete = access(marker, F_OK) == 0;
+    mkdir(bench->datadir, 0755);
+
+    bench->count = dataset->count;
+    bench->bytes = 0;
+    bench->names = malloc(dataset->count*sizeof(char *));
+    for(size_t i=0; i < dataset->count; i++){
+        char name[BENCH_NAME_SIZE];
+        snprintf(name, sizeof(name), "%c%07u.log", dataset->name[0], (unsigned)(i%10000000));
+        bench->names[i] = strdup(name);
+        long long size = benchSize(dataset, i);
+        bench->bytes += size;
+        if(!isComplete){
+            char pathname[4200];
+            snprintf(pathname, sizeof(pathname), "%s/%s", bench->datadir, name);
+            benchGenerateFile(bench, pathname, size, i);
+        }
+    }
+    if(!isComplete){
+        close(open(marker, O_WRONLY | O_CREAT, 0644));
+    }
+}
+
+void benchEvict(char *pathname){
+    /**
+     * Drop file from the page cache, regular files in a directory included
+     * :param pathname: On-disk file or directory path
+     * :return: None
+     */
+    struct stat filedata;
+    if(stat(pathname, &filedata) == -1){
+        return;
+    }
+    if(S_ISDIR(filedata.st_mode)){
+        DIR *dir = opendir(pathname);
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL){
+            if(entry->d_name[0] != '.'){
+                char child[4200];
+                snprintf(child, sizeof(child), "%s/%s", pathname, entry->d_name);
+                benchEvict(child);
+            }
+        }
+        closedir(dir);
+        return;
+    }
+    int fd = open(pathname, O_RDONLY);
+    if(fd != -1){
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+void benchClear(char *pathname){
+    /**
+     * Remove every file in directory
+     * :param pathname: On-disk directory path
+     * :return: None
+     */
+    DIR *dir = opendir(pathname);
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL){
+        if(strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0){
+            char child[4200];
+            snprintf(child, sizeof(child), "%s/%s", pathname, entry->d_name);
+            unlink(child);
+        }
+    }
+    closedir(dir);
+}
+
+void benchCopy(char *source, char *destination){
+    /**
+     * Copy file, in the kernel where possible
+     * :param source: On-disk source file path
+     * :param destination: On-disk destination file path
+     * :return: None
+     */
+    int in = open(source, O_RDONLY);
+    int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat filedata;
+    if(in == -1 || out == -1 || fstat(in, &filedata) == -1){ // Error handling
+        fprintf(stderr, "Error: Cannot copy file \"%s\"\n", source);
+        exit(EXIT_FAILURE);
+    }
+    off_t remaining = filedata.st_size;
+    while(remaining > 0){
+        ssize_t count = copy_file_range(in, NULL, out, NULL, remaining, 0);
+        if(count <= 0){ // Error handling
+            fprintf(stderr, "Error: Cannot copy file \"%s\"\n", source);
+            exit(EXIT_FAILURE);
+        }
+        remaining -= count;
+    }
+    close(in);
+    close(out);
+}
+
+double benchCommand(char *directory, char **argv, struct rusage *usage){
+    /**
+     * Run command with standard output discarded
+     * :param directory: Working directory of the command
+     * :param argv: Command arguments, NULL terminated
+     * :param usage: Destination of command resource usage
+     * :return: Wall seconds
+     */
+    double start = benchNow();
+    pid_t pid = fork();
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+        if(chdir(directory) == -1 || dup2(null, STDOUT_FILENO) == -1){
+            _exit(127);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if(pid == -1 || wait4(pid, &status, 0, usage) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){ // Error handling
+        fprintf(stderr, "Error: Command \"%s %s\" failed\n", argv[0], argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    return benchNow()-start;
+}
+
+double benchBatches(char *directory, char **prefix, int prefixCount, char **names, size_t count, benchResultStruct *result){
+    /**
+     * Run command over file operands in batches of BENCH_BATCH
+     * :param directory: Working directory of the command
+     * :param prefix: Command and arguments before the file operands
+     * :param prefixCount: Prefix argument count
+     * :param names: File operands
+     * :param count: File operand count, 0 runs the prefix alone
+     * :param result: Resource usage accumulator
+     * :return: Wall seconds of every batch
+     */
+    char **argv = malloc((prefixCount+BENCH_BATCH+1)*sizeof(char *));
+    memcpy(argv, prefix, prefixCount*sizeof(char *));
+    double seconds = 0;
+    size_t i = 0;
+    do{
+        size_t batch = count-i < BENCH_BATCH ? count-i : BENCH_BATCH;
+        memcpy(argv+prefixCount, names+i, batch*sizeof(char *));
+        argv[prefixCount+batch] = NULL;
+        struct rusage usage;
+        seconds += benchCommand(directory, argv, &usage);
+        result->userSeconds += usage.ru_utime.tv_sec+usage.ru_utime.tv_usec/1e6;
+        result->systemSeconds += usage.ru_stime.tv_sec+usage.ru_stime.tv_usec/1e6;
+        if(usage.ru_maxrss > result->maxRss){
+            result->maxRss = usage.ru_maxrss;
+        }
+        i += batch;
+    }while(i < count);
+    free(argv);
+    return seconds;
+}
+
+double benchOperation(benchStruct *bench, int tool, char *operation, int isCold, benchResultStruct *result){
+    /**
+     * Prepare and time one run of an operation
+     * :param bench: Benchmark state with a generated dataset
+     * :param tool: 0 for myar, 1 for GNU ar
+     * :param operation: myar option letter
+     * :param isCold: Evict the operation's inputs first
+     * :param result: Resource usage accumulator
+     * :return: Wall seconds
+     */
+    char *executable = bench->tools[tool];
+    char reference[4200], archive[4200], extractdir[4200];
+    snprintf(reference, sizeof(reference), "%s.%s.a", bench->datadir, tool == 0 ? "myar" : "ar");
+    snprintf(archive, sizeof(archive), "%s.%s.work.a", bench->datadir, tool == 0 ? "myar" : "ar");
+    snprintf(extractdir, sizeof(extractdir), "%s.extract", bench->datadir);
+
+    if(strcmp(operation, "q") == 0 || strcmp(operation, "A") == 0){
+        unlink(archive);
+        if(strcmp(operation, "A") == 0){ // -A appends to an existing archive
+            int fd = open(archive, O_WRONLY | O_CREAT, 0644);
+            if(fd == -1 || write(fd, "!<arch>\n", 8) != 8){ // Error handling
+                fprintf(stderr, "Error: Cannot create file \"%s\"\n", archive);
+                exit(EXIT_FAILURE);
+            }
+            close(fd);
+        }
+        if(isCold){
+            benchEvict(bench->datadir);
+        }
+        if(tool == 0 && strcmp(operation, "A") == 0){
+            char *prefix[] = {executable, "-A", archive};
+            return benchBatches(bench->datadir, prefix, 3, NULL, 0, result);
+        }
+        char *prefix[] = {executable, tool == 0 ? "-q" : "qc", archive};
+        return benchBatches(bench->datadir, prefix, 3, bench->names, bench->count, result);
+    }
+
+    if(strcmp(operation, "d") == 0){
+        benchCopy(reference, archive);
+    }else{
+        snprintf(archive, sizeof(archive), "%s", reference);
+    }
+    if(strcmp(operation, "x") == 0){
+        mkdir(extractdir, 0755);
+        benchClear(extractdir);
+    }
+    if(isCold){
+        benchEvict(archive);
+    }
+    if(strcmp(operation, "d") == 0){
+        size_t count = (bench->count+BENCH_DELETE_STRIDE-1)/BENCH_DELETE_STRIDE;
+        char **names = malloc(count*sizeof(char *));
+        for(size_t i=0; i < count; i++){
+            names[i] = bench->names[i*BENCH_DELETE_STRIDE];
+        }
+        char *prefix[] = {executable, tool == 0 ? "-d" : "d", archive};
+        double seconds = benchBatches(bench->datadir, prefix, 3, names, count, result);
+        free(names);
+        return seconds;
+    }
+    char *option = tool == 0 ? (strcmp(operation, "t") == 0 ? "-t" : strcmp(operation, "v") == 0 ? "-v" : "-x") :
+            (strcmp(operation, "t") == 0 ? "t" : strcmp(operation, "v") == 0 ? "tv" : "x");
+    char *prefix[] = {executable, option, archive};
+    return benchBatches(strcmp(operation, "x") == 0 ? extractdir : bench->datadir, prefix, 3, NULL, 0, result);
+}
+
+int benchCompareSeconds(const void *a, const void *b){
+    /**
+     * Order wall times ascending
+     * :param a: Wall time
+     * :param b: Wall time
+     * :return: Comparison
+     */
+    double difference = *(const double *)a-*(const double *)b;
+    return (difference > 0)-(difference < 0);
+}
+
+void benchRecord(benchStruct *bench, benchDatasetStruct *dataset, int tool, char *operation, int isCold, benchResultStruct *result){
+    /**
+     * Append measurement to the results file and print it
+     * :param bench: Benchmark state
+     * :param dataset: Dataset
+     * :param tool: 0 for myar, 1 for GNU ar
+     * :param operation: myar option letter
+     * :param isCold: Cold page cache
+     * :param result: Timed runs
+     * :return: None
+     */
+    qsort(result->seconds, bench->runs, sizeof(double), benchCompareSeconds);
+    double minimum = result->seconds[0], median = result->seconds[bench->runs/2];
+    FILE *file = fopen(bench->results, "a");
+    if(file == NULL){ // Error handling
+        fprintf(stderr, "Error: Cannot open file \"%s\"\n", bench->results);
+        exit(EXIT_FAILURE);
+    }
+    if(ftell(file) == 0){
+        fprintf(file, "release,time,dataset,members,bytes,tool,operation,cache,runs,seconds_min,seconds_median,"
+                "user_seconds,system_seconds,max_rss_kib,mib_per_second,members_per_second\n");
+    }
+    fprintf(file, "%s,%ld,%s,%zu,%lld,%s,%s,%s,%d,%.6f,%.6f,%.6f,%.6f,%ld,%.3f,%.1f\n",
+            bench->release, (long)time(NULL), dataset->name, bench->count, bench->bytes, tool == 0 ? "myar" : "ar",
+            operation, isCold ? "cold" : "warm", bench->runs, minimum, median,
+            result->userSeconds/bench->runs, result->systemSeconds/bench->runs, result->maxRss,
+            bench->bytes/median/(1 << 20), bench->count/median);
+    fclose(file);
+    printf("%-6s %-5s -%s %-4s %10.4f s %10.1f MiB/s %12.0f members/s %8ld KiB\n", dataset->name,
+            tool == 0 ? "myar" : "ar", operation, isCold ? "cold" : "warm", median,
+            bench->bytes/median/(1 << 20), bench->count/median, result->maxRss);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv){
+    benchStruct bench = {"/tmp/myar-bench", "bench/results.csv", getenv("BENCH_RELEASE"), {NULL, "ar"}, 3};
+    benchDatasetStruct *datasets = benchQuick;
+    int opt;
+    while((opt = getopt(argc, argv, "s:r:w:o:")) != -1){
+        if(opt == 's' && strcmp(optarg, "full") == 0){
+            datasets = benchFull;
+        }else if(opt == 's' && strcmp(optarg, "quick") == 0){
+            datasets = benchQuick;
+        }else if(opt == 'r' && atoi(optarg) > 0 && atoi(optarg) <= BENCH_MAX_RUNS){
+            bench.runs = atoi(optarg);
+        }else if(opt == 'w'){
+            bench.workdir = optarg;
+        }else if(opt == 'o'){
+            bench.results = optarg;
+        }else{ // Error handling
+            fprintf(stderr, "Error: Usage \"bench/archive [-s quick|full] [-r runs] [-w workdir] [-o results] [myar]\"\n");
+            return EXIT_FAILURE;
+        }
+    }
+    bench.tools[0] = realpath(optind < argc ? argv[optind] : "bench/myar", NULL);
+    if(bench.tools[0] == NULL){ // Error handling
+        fprintf(stderr, "Error: Cannot find myar executable\n");
+        return EXIT_FAILURE;
+    }
+    if(bench.release == NULL){
+        bench.release = "unknown";
+    }
+    mkdir(bench.workdir, 0755);
+
+    // Printable log-like lines, so -A accepts every file
+    bench.text = malloc(BENCH_TEXT_SIZE);
+    const char *words[] = {"INFO", "WARN", "request", "served", "in", "ms", "user", "cache", "miss", "=", "{", "}", "/api/v1"};
+    size_t length = 0;
+    unsigned state = 1;
+    while(length < BENCH_TEXT_SIZE){
+        state = state*1103515245+12345;
+        const char *word = (state >> 16)%17 == 0 ? "\n" : words[(state >> 16)%13];
+        for(const char *cur = word; *cur != '\0' && length < BENCH_TEXT_SIZE; cur++){
+            bench.text[length++] = *cur;
+        }
+        if(length < BENCH_TEXT_SIZE && word[0] != '\n'){
+            bench.text[length++] = ' ';
+        }
+    }
+
+    for(int d=0; d < 3; d++){
+        benchDatasetStruct *dataset = &datasets[d];
+        printf("generating %s: %zu members\n", dataset->name, dataset->count);
+        fflush(stdout);
+        benchGenerate(&bench, dataset);
+        for(int tool=0; tool < 2; tool++){
+            // Reference archive read by -t, -v, -x and -d
+            char reference[4200];
+            snprintf(reference, sizeof(reference), "%s.%s.a", bench.datadir, tool == 0 ? "myar" : "ar");
+            unlink(reference);
+            benchResultStruct unused = {{0}};
+            char *prefix[] = {bench.tools[tool], tool == 0 ? "-q" : "qc", reference};
+            benchBatches(bench.datadir, prefix, 3, bench.names, bench.count, &unused);
+
+            for(size_t o=0; o < sizeof(benchOperations)/sizeof(char *); o++){
+                for(int isCold=1; isCold >= 0; isCold--){
+                    benchResultStruct result = {{0}};
+                    if(!isCold){ // Warm up
+                        benchResultStruct warmup = {{0}};
+                        benchOperation(&bench, tool, benchOperations[o], 0, &warmup);
+                    }
+                    for(int run=0; run < bench.runs; run++){
+                        result.seconds[run] = benchOperation(&bench, tool, benchOperations[o], isCold, &result);
+                    }
+                    benchRecord(&bench, dataset, tool, benchOperations[o], isCold, &result);
+                }
+            }
+        }
+        for(size_t i=0; i < bench.count; i++){
+            free(bench.names[i]);
+        }
+        free(bench.names);
+    }
+    free(bench.text);
+    free(bench.tools[0]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../classify.h"
+
+
+#define BENCH_BUFFER_SIZE (64 << 20)
+#define BENCH_ROUNDS 8
+
+
+size_t classifyTextCtype(const unsigned char *buffer, size_t count){
+    /**
+     * Text prefix length with the original ctype test, for comparison
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Position of first non-text byte, count if all text
+     */
+    for(size_t i=0; i < count; i++){
+        if(!isalnum(buffer[i]) && !isspace(buffer[i]) && !ispunct(buffer[i])){
+            return i;
+        }
+    }
+    return count;
+}
+
+void benchClassify(char *label, size_t (*classify)(const unsigned char *, size_t), const unsigned char *buffer, size_t count){
+    /**
+     * Print classifier throughput over buffer
+     * :param label: Classifier name
+     * :param classify: Classifier
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: None
+     */
+    struct timespec start, end;
+    size_t result = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i=0; i < BENCH_ROUNDS; i++){
+        result += classify(buffer, count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec-start.tv_sec)+(end.tv_nsec-start.tv_nsec)/1e9;
+    printf("%-8s %10.1f MiB/s (prefix %zu)\n", label, (double)count*BENCH_ROUNDS/seconds/(1 << 20), result/BENCH_ROUNDS);
+}
+
+int main(void){
+    unsigned char *buffer = malloc(BENCH_BUFFER_SIZE);
+    const char *line = "The quick brown fox jumps over the lazy dog; 0123456789 {}[]()\t\r\n";
+    size_t length = strlen(line);
+    for(size_t i=0; i < BENCH_BUFFER_SIZE; i++){
+        buffer[i] = line[i%length];
+    }
+
+    // Every classifier must agree with the original ctype test
+    for(size_t i=0; i < 4096; i++){
+        unsigned char probe[64];
+        memcpy(probe, buffer, sizeof(probe));
+        probe[i%sizeof(probe)] = i/sizeof(probe);
+        size_t expected = classifyTextCtype(probe, sizeof(probe));
+        if(classifyTextScalar(probe, sizeof(probe)) != expected
+#ifdef CLASSIFY_X86
+                || classifyTextSse2(probe, sizeof(probe)) != expected
+                || (__builtin_cpu_supports("avx2") && classifyTextAvx2(probe, sizeof(probe)) != expected)
+#endif
+                ){
+            fprintf(stderr, "Error: Classifiers disagree on byte 0x%02zx\n", i/sizeof(probe));
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("text buffer, %d MiB\n", BENCH_BUFFER_SIZE >> 20);
+    benchClassify("ctype", classifyTextCtype, buffer, BENCH_BUFFER_SIZE);
+    benchClassify("scalar", classifyTextScalar, buffer, BENCH_BUFFER_SIZE);
+#ifdef CLASSIFY_X86
+    benchClassify("sse2", classifyTextSse2, buffer, BENCH_BUFFER_SIZE);
+    if(__builtin_cpu_supports("avx2")){
+        benchClassify("avx2", classifyTextAvx2, buffer, BENCH_BUFFER_SIZE);
+    }
+#endif
+    free(buffer);
+    return EXIT_SUCCESS;
+}
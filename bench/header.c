@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../header.h"
+
+
+#define BENCH_HEADERS 4096
+#define BENCH_ROUNDS 256
+
+
+long headerFieldSscanf(char *field, int fieldSize){
+    /**
+     * Parse numeric field with the original sscanf path, for comparison
+     * :param field: Header field, not NUL terminated
+     * :param fieldSize: Field width
+     * :return: Field value, 0 if unparseable
+     */
+    char buffer[16];
+    memcpy(buffer, field, fieldSize);
+    buffer[fieldSize] = '\0';
+    long value = 0;
+    sscanf(buffer, "%ld", &value);
+    return value;
+}
+
+double benchSeconds(struct timespec *start){
+    /**
+     * Seconds elapsed since start
+     * :param start: Monotonic start time
+     * :return: Seconds
+     */
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec-start->tv_sec)+(end.tv_nsec-start->tv_nsec)/1e9;
+}
+
+int main(void){
+    struct ar_hdr *headers = malloc(BENCH_HEADERS*sizeof(struct ar_hdr));
+    srand(1);
+    for(int i=0; i < BENCH_HEADERS; i++){
+        memset(&headers[i], ' ', sizeof(struct ar_hdr));
+        headerFormatField(headers[i].ar_date, sizeof(headers[i].ar_date), HEADER_DECIMAL, 1600000000L+rand());
+        headerFormatField(headers[i].ar_uid, sizeof(headers[i].ar_uid), HEADER_DECIMAL, rand()%65536);
+        headerFormatField(headers[i].ar_gid, sizeof(headers[i].ar_gid), HEADER_DECIMAL, rand()%65536);
+        headerFormatField(headers[i].ar_mode, sizeof(headers[i].ar_mode), HEADER_OCTAL, 0100644);
+        headerFormatField(headers[i].ar_size, sizeof(headers[i].ar_size), HEADER_DECIMAL, rand());
+    }
+
+    // The codec must agree with sscanf on decimal fields
+    for(int i=0; i < BENCH_HEADERS; i++){
+        int64_t value;
+        if(!headerParseField(headers[i].ar_size, sizeof(headers[i].ar_size), HEADER_DECIMAL, &value) ||
+                value != headerFieldSscanf(headers[i].ar_size, sizeof(headers[i].ar_size))){
+            fprintf(stderr, "Error: Codec disagrees with sscanf on header %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    char field[10];
+    if(headerFormatField(field, sizeof(field), HEADER_DECIMAL, 10000000000L) || headerFormatField(field, sizeof(field), HEADER_DECIMAL, -1)){
+        fprintf(stderr, "Error: Codec formats a value wider than its field\n");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start;
+    long sum = 0;
+    size_t fields = (size_t)BENCH_HEADERS*BENCH_ROUNDS*5;
+    printf("%d headers x %d rounds, 5 fields each\n", BENCH_HEADERS, BENCH_ROUNDS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        for(int i=0; i < BENCH_HEADERS; i++){
+            struct ar_hdr *header = &headers[i];
+            sum += headerFieldSscanf(header->ar_date, sizeof(header->ar_date));
+            sum += headerFieldSscanf(header->ar_uid, sizeof(header->ar_uid));
+            sum += headerFieldSscanf(header->ar_gid, sizeof(header->ar_gid));
+            sum += headerFieldSscanf(header->ar_mode, sizeof(header->ar_mode));
+            sum += headerFieldSscanf(header->ar_size, sizeof(header->ar_size));
+        }
+    }
+    printf("%-14s %8.1f ns/field\n", "parse sscanf", benchSeconds(&start)*1e9/fields);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        for(int i=0; i < BENCH_HEADERS; i++){
+            struct ar_hdr *header = &headers[i];
+            int64_t value = 0;
+            headerParseField(header->ar_date, sizeof(header->ar_date), HEADER_DECIMAL, &value);
+            sum += value;
+            headerParseField(header->ar_uid, sizeof(header->ar_uid), HEADER_DECIMAL, &value);
+            sum += value;
+            headerParseField(header->ar_gid, sizeof(header->ar_gid), HEADER_DECIMAL, &value);
+            sum += value;
+            headerParseField(header->ar_mode, sizeof(header->ar_mode), HEADER_OCTAL, &value);
+            sum += value;
+            headerParseField(header->ar_size, sizeof(header->ar_size), HEADER_DECIMAL, &value);
+            sum += value;
+        }
+    }
+    printf("%-14s %8.1f ns/field\n", "parse codec", benchSeconds(&start)*1e9/fields);
+
+    struct ar_hdr header;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        for(int i=0; i < BENCH_HEADERS; i++){
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "%ld", 1600000000L+i);
+            memcpy(header.ar_date, buffer, sizeof(header.ar_date));
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            memcpy(header.ar_uid, buffer, sizeof(header.ar_uid));
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            memcpy(header.ar_gid, buffer, sizeof(header.ar_gid));
+            snprintf(buffer, sizeof(buffer), "%o", 0100644);
+            memcpy(header.ar_mode, buffer, sizeof(header.ar_mode));
+            snprintf(buffer, sizeof(buffer), "%d", i*round);
+            memcpy(header.ar_size, buffer, sizeof(header.ar_size));
+            sum += header.ar_size[0];
+        }
+    }
+    printf("%-14s %8.1f ns/field\n", "format sprintf", benchSeconds(&start)*1e9/fields);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        for(int i=0; i < BENCH_HEADERS; i++){
+            headerFormatField(header.ar_date, sizeof(header.ar_date), HEADER_DECIMAL, 1600000000L+i);
+            headerFormatField(header.ar_uid, sizeof(header.ar_uid), HEADER_DECIMAL, i);
+            headerFormatField(header.ar_gid, sizeof(header.ar_gid), HEADER_DECIMAL, i);
+            headerFormatField(header.ar_mode, sizeof(header.ar_mode), HEADER_OCTAL, 0100644);
+            headerFormatField(header.ar_size, sizeof(header.ar_size), HEADER_DECIMAL, i*round);
+            sum += header.ar_size[0];
+        }
+    }
+    printf("%-14s %8.1f ns/field\n", "format codec", benchSeconds(&start)*1e9/fields);
+
+    printf("(checksum %ld)\n", sum);
+    free(headers);
+    return EXIT_SUCCESS;
+}
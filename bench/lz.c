@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../hash.h"
+#include "../lz.h"
+
+
+#define BENCH_SIZE (64 << 20)
+#define BENCH_ROUNDS 4
+
+
+double benchSeconds(struct timespec *start){
+    /**
+     * Seconds elapsed since start
+     * :param start: Monotonic start time
+     * :return: Seconds
+     */
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec-start->tv_sec)+(end.tv_nsec-start->tv_nsec)/1e9;
+}
+
+void benchText(unsigned char *data, size_t size){
+    /**
+     * Fill buffer with log-like text, the archives -z is meant for
+     * :param data: Destination
+     * :param size: Bytes to fill
+     * :return: None
+     */
+    char *levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    char *modules[] = {"reader", "writer", "catalog", "index", "pool"};
+    char line[160];
+    size_t used = 0;
+    for(unsigned i=0; used < size; i++){
+        int length = snprintf(line, sizeof(line), "2024-03-%02u 12:%02u:%02u.%03u %s [%s] request=%u bytes=%u status=%s\n",
+                1+i/86400%28, i/60%60, i%60, (unsigned)rand()%1000, levels[rand()%4], modules[rand()%5],
+                (unsigned)rand()%100000, (unsigned)rand()%65536, rand()%16 ? "ok" : "retry");
+        size_t count = size-used < (size_t)length ? size-used : (size_t)length;
+        memcpy(data+used, line, count);
+        used += count;
+    }
+}
+
+int benchRun(char *name, unsigned char *data, size_t size){
+    /**
+     * Compress and decompress data in LZ_BLOCK_SIZE blocks and print rates
+     * :param name: Data set name
+     * :param data: Uncompressed data
+     * :param size: Uncompressed bytes, a multiple of LZ_BLOCK_SIZE
+     * :return: Round trip matched
+     */
+    size_t blocks = size/LZ_BLOCK_SIZE;
+    unsigned char *compressed = malloc(size);
+    unsigned char *restored = malloc(size);
+    size_t *lengths = malloc(blocks*sizeof(size_t));
+    struct timespec start;
+
+    size_t total = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        total = 0;
+        for(size_t i=0; i < blocks; i++){
+            lengths[i] = lzCompressBlock(data+i*LZ_BLOCK_SIZE, LZ_BLOCK_SIZE, compressed+total, LZ_BLOCK_SIZE-1);
+            if(lengths[i] == 0){ // Stored as is
+                memcpy(compressed+total, data+i*LZ_BLOCK_SIZE, LZ_BLOCK_SIZE);
+                lengths[i] = LZ_BLOCK_SIZE;
+            }
+            total += lengths[i];
+        }
+    }
+    double compressSeconds = benchSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round=0; round < BENCH_ROUNDS; round++){
+        size_t offset = 0;
+        for(size_t i=0; i < blocks; i++){
+            if(lengths[i] == LZ_BLOCK_SIZE){
+                memcpy(restored+i*LZ_BLOCK_SIZE, compressed+offset, LZ_BLOCK_SIZE);
+            }else if(lzDecompressBlock(compressed+offset, lengths[i], restored+i*LZ_BLOCK_SIZE, LZ_BLOCK_SIZE) != LZ_BLOCK_SIZE){
+                fprintf(stderr, "Error: Block %zu of %s did not decompress\n", i, name);
+                return 0;
+            }
+            offset += lengths[i];
+        }
+    }
+    double decompressSeconds = benchSeconds(&start);
+
+    int isMatched = memcmp(data, restored, size) == 0;
+    double megabytes = (double)size*BENCH_ROUNDS/(1 << 20);
+    printf("%-8s ratio %5.2f  compress %7.1f MiB/s  decompress %7.1f MiB/s%s\n", name, (double)size/total,
+            megabytes/compressSeconds, megabytes/decompressSeconds, isMatched ? "" : "  MISMATCH");
+    free(compressed);
+    free(restored);
+    free(lengths);
+    return isMatched;
+}
+
+int main(void){
+    unsigned char *data = malloc(BENCH_SIZE);
+    srand(1);
+    printf("%d MiB x %d rounds, %d KiB blocks\n", BENCH_SIZE >> 20, BENCH_ROUNDS, LZ_BLOCK_SIZE >> 10);
+
+    benchText(data, BENCH_SIZE);
+    int isMatched = benchRun("text", data, BENCH_SIZE);
+
+    for(size_t i=0; i < BENCH_SIZE; i++){
+        data[i] = rand();
+    }
+    isMatched &= benchRun("random", data, BENCH_SIZE);
+
+    free(data);
+    return isMatched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,315 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "ar.h"
+
+
+#define CATALOG_NAME "__.CATALOG"
+#define CATALOG_MAGIC "MYARCT2\n"
+#define CATALOG_MAGIC_SIZE 8
+#define CATALOG_MODE "100644" // regular file, rw-r--r--
+
+
+/* Catalog member body: a preamble, one record per archived file in archive
+   order, then one slot per record sorted by archived file name and record
+   position, so a name is found by binary search over the slots. Records
+   and slots are laid out for the body's full capacity, and unused trailing
+   ones are space filled so the catalog can shrink in place. Numbers are
+   ASCII decimal, space padded, except slot record positions which are zero
+   padded so slots sort as bytes, and content hashes which are lowercase hex
+   and space filled when the archived file has not been hashed yet. Slot
+   names are parsed from the copied headers, so header.h is included
+   before this file. */
+
+typedef struct catalogPreamble{
+    char cp_magic[8]; // CATALOG_MAGIC
+    char cp_count[12]; // records in use
+    char cp_end[20]; // archive file offset covered by the records
+}catalogPreambleStruct;
+
+typedef struct catalogRecord{
+    char cr_offset[20]; // archive file offset of archived file header
+    char cr_hash[16]; // content hash of archived file body, see hash.h
+    struct ar_hdr cr_hdr; // copy of archived file header
+}catalogRecordStruct;
+
+typedef struct catalogSlot{
+    char cs_name[16]; // archived file name, space padded
+    char cs_record[12]; // record position, zero padded
+}catalogSlotStruct;
+
+
+size_t catalogBodySize(size_t count);
+size_t catalogCapacity(size_t bodySize);
+void catalogFormatField(char *field, int fieldSize, int64_t value);
+int64_t catalogParseField(char *field, int fieldSize);
+void catalogHeader(struct ar_hdr *header, size_t bodySize);
+int catalogIsHeader(struct ar_hdr *header);
+void catalogWritePreamble(char *body, size_t bodySize, size_t count, off_t end);
+void catalogWriteRecord(char *body, size_t i, off_t offset, struct ar_hdr *header, int isHashed, uint64_t hash);
+int catalogRecordHash(catalogRecordStruct *record, uint64_t *hash);
+int catalogReadPreamble(char *body, size_t bodySize, size_t *count, off_t *end);
+catalogRecordStruct *catalogRecord(char *body, size_t i);
+size_t catalogRecordOffset(size_t i);
+size_t catalogSlotOffset(size_t bodySize, size_t i);
+int catalogSlotName(catalogSlotStruct *slot, const char *name);
+int catalogCompareSlots(const void *left, const void *right);
+
+
+size_t catalogBodySize(size_t count){
+    /**
+     * Catalog member body size for a number of records
+     * :param count: Record count
+     * :return: Body size in bytes, always even
+     */
+    return sizeof(catalogPreambleStruct)+count*(sizeof(catalogRecordStruct)+sizeof(catalogSlotStruct));
+}
+
+size_t catalogCapacity(size_t bodySize){
+    /**
+     * Records that fit in a catalog member body
+     * :param bodySize: Body size in bytes
+     * :return: Record capacity
+     */
+    if(bodySize < sizeof(catalogPreambleStruct)){
+        return 0;
+    }
+    return (bodySize-sizeof(catalogPreambleStruct))/(sizeof(catalogRecordStruct)+sizeof(catalogSlotStruct));
+}
+
+void catalogFormatField(char *field, int fieldSize, int64_t value){
+    /**
+     * Write decimal into space padded fixed width field
+     * :param field: Destination field
+     * :param fieldSize: Field width
+     * :param value: Non-negative value
+     * :return: None
+     */
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+    memset(field, ' ', fieldSize);
+    memcpy(field, buffer, length < fieldSize ? length : fieldSize);
+}
+
+int64_t catalogParseField(char *field, int fieldSize){
+    /**
+     * Read decimal from space padded fixed width field
+     * :param field: Source field
+     * :param fieldSize: Field width
+     * :return: Field value, -1 if not a number
+     */
+    int64_t value = 0;
+    int i = 0;
+    while(i < fieldSize && field[i] >= '0' && field[i] <= '9'){
+        if(value > (INT64_MAX-(field[i]-'0'))/10){ // Overflow
+            return -1;
+        }
+        value = value*10+(field[i]-'0');
+        i++;
+    }
+    if(i == 0){
+        return -1;
+    }
+    while(i < fieldSize && field[i] == ' '){
+        i++;
+    }
+    return i == fieldSize ? value : -1;
+}
+
+void catalogHeader(struct ar_hdr *header, size_t bodySize){
+    /**
+     * Fill archived file header of catalog member
+     * :param header: Destination header
+     * :param bodySize: Catalog member body size
+     * :return: None
+     */
+    memset(header, ' ', sizeof(struct ar_hdr));
+    memcpy(header->ar_name, CATALOG_NAME, strlen(CATALOG_NAME));
+    catalogFormatField(header->ar_date, sizeof(header->ar_date), 0);
+    catalogFormatField(header->ar_uid, sizeof(header->ar_uid), 0);
+    catalogFormatField(header->ar_gid, sizeof(header->ar_gid), 0);
+    memcpy(header->ar_mode, CATALOG_MODE, strlen(CATALOG_MODE));
+    catalogFormatField(header->ar_size, sizeof(header->ar_size), bodySize);
+    memcpy(header->ar_fmag, ARFMAG, sizeof(header->ar_fmag));
+}
+
+int catalogIsHeader(struct ar_hdr *header){
+    /**
+     * Archived file header names the catalog member
+     * GNU ar adds its slash terminator when it rewrites the archive
+     * :param header: Archived file header
+     * :return: Is catalog member
+     */
+    size_t length = strlen(CATALOG_NAME);
+    if(memcmp(header->ar_name, CATALOG_NAME, length) != 0){
+        return 0;
+    }
+    if(header->ar_name[length] == '/'){
+        length++;
+    }
+    for(size_t i=length; i < sizeof(header->ar_name); i++){
+        if(header->ar_name[i] != ' ' && header->ar_name[i] != '\0'){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void catalogWritePreamble(char *body, size_t bodySize, size_t count, off_t end){
+    /**
+     * Write catalog preamble, sort the name slots of the records in use and
+     * blank the unused records and slots
+     * :param body: Catalog member body
+     * :param bodySize: Catalog member body size
+     * :param count: Records in use
+     * :param end: Archive file offset covered by the records
+     * :return: None
+     */
+    catalogPreambleStruct *preamble = (catalogPreambleStruct *)body;
+    memcpy(preamble->cp_magic, CATALOG_MAGIC, CATALOG_MAGIC_SIZE);
+    catalogFormatField(preamble->cp_count, sizeof(preamble->cp_count), count);
+    catalogFormatField(preamble->cp_end, sizeof(preamble->cp_end), end);
+    size_t capacity = catalogCapacity(bodySize);
+    size_t slotsOffset = catalogSlotOffset(bodySize, 0);
+    memset(body+catalogRecordOffset(count), ' ', slotsOffset-catalogRecordOffset(count));
+
+    // Sort name slots
+    char name[sizeof(((struct ar_hdr *)body)->ar_name)+1];
+    char position[32];
+    catalogSlotStruct *slots = (catalogSlotStruct *)(body+slotsOffset);
+    for(size_t i=0; i < count; i++){
+        headerParseName(&catalogRecord(body, i)->cr_hdr, name);
+        catalogSlotName(&slots[i], name);
+        snprintf(position, sizeof(position), "%012zu", i);
+        memcpy(slots[i].cs_record, position, sizeof(slots[i].cs_record));
+    }
+    qsort(slots, count, sizeof(catalogSlotStruct), catalogCompareSlots);
+    memset(slots+count, ' ', (capacity-count)*sizeof(catalogSlotStruct));
+}
+
+void catalogWriteRecord(char *body, size_t i, off_t offset, struct ar_hdr *header, int isHashed, uint64_t hash){
+    /**
+     * Write catalog record of archived file
+     * :param body: Catalog member body
+     * :param i: Record position
+     * :param offset: Archive file offset of archived file header
+     * :param header: Archived file header
+     * :param isHashed: Content hash is known
+     * :param hash: Content hash of archived file body
+     * :return: None
+     */
+    catalogRecordStruct *record = catalogRecord(body, i);
+    catalogFormatField(record->cr_offset, sizeof(record->cr_offset), offset);
+    memset(record->cr_hash, ' ', sizeof(record->cr_hash));
+    if(isHashed){
+        char buffer[sizeof(record->cr_hash)+1];
+        snprintf(buffer, sizeof(buffer), "%016" PRIx64, hash);
+        memcpy(record->cr_hash, buffer, sizeof(record->cr_hash));
+    }
+    memcpy(&record->cr_hdr, header, sizeof(struct ar_hdr));
+}
+
+int catalogRecordHash(catalogRecordStruct *record, uint64_t *hash){
+    /**
+     * Read content hash from catalog record
+     * :param record: Catalog record
+     * :param hash: Destination of content hash
+     * :return: Content hash is known
+     */
+    uint64_t value = 0;
+    for(size_t i=0; i < sizeof(record->cr_hash); i++){
+        char c = record->cr_hash[i];
+        if(c >= '0' && c <= '9'){
+            value = value << 4 | (c-'0');
+        }else if(c >= 'a' && c <= 'f'){
+            value = value << 4 | (c-'a'+10);
+        }else{
+            return 0;
+        }
+    }
+    *hash = value;
+    return 1;
+}
+
+int catalogReadPreamble(char *body, size_t bodySize, size_t *count, off_t *end){
+    /**
+     * Read and validate catalog preamble
+     * :param body: Catalog member body
+     * :param bodySize: Catalog member body size
+     * :param count: Destination of records in use
+     * :param end: Destination of archive file offset covered by the records
+     * :return: Preamble is valid
+     */
+    if(bodySize < sizeof(catalogPreambleStruct)){
+        return 0;
+    }
+    catalogPreambleStruct *preamble = (catalogPreambleStruct *)body;
+    if(memcmp(preamble->cp_magic, CATALOG_MAGIC, CATALOG_MAGIC_SIZE) != 0){
+        return 0;
+    }
+    int64_t parsedCount = catalogParseField(preamble->cp_count, sizeof(preamble->cp_count));
+    int64_t parsedEnd = catalogParseField(preamble->cp_end, sizeof(preamble->cp_end));
+    if(parsedCount < 0 || parsedEnd < 0 || (size_t)parsedCount > catalogCapacity(bodySize)){
+        return 0;
+    }
+    *count = parsedCount;
+    *end = parsedEnd;
+    return 1;
+}
+
+catalogRecordStruct *catalogRecord(char *body, size_t i){
+    /**
+     * Catalog record at position
+     * :param body: Catalog member body
+     * :param i: Record position
+     * :return: Catalog record view into body
+     */
+    return (catalogRecordStruct *)(body+catalogRecordOffset(i));
+}
+
+size_t catalogRecordOffset(size_t i){
+    /**
+     * Catalog body offset of record at position
+     * :param i: Record position
+     * :return: Body offset
+     */
+    return sizeof(catalogPreambleStruct)+i*sizeof(catalogRecordStruct);
+}
+
+size_t catalogSlotOffset(size_t bodySize, size_t i){
+    /**
+     * Catalog body offset of name slot at position, past every record
+     * :param bodySize: Catalog member body size
+     * :param i: Slot position in name order
+     * :return: Body offset
+     */
+    return sizeof(catalogPreambleStruct)+catalogCapacity(bodySize)*sizeof(catalogRecordStruct)+i*sizeof(catalogSlotStruct);
+}
+
+int catalogSlotName(catalogSlotStruct *slot, const char *name){
+    /**
+     * Write archived file name into space padded slot name
+     * :param slot: Destination slot
+     * :param name: Archived file name
+     * :return: Name fits the slot, a longer name is in no catalog
+     */
+    size_t length = strlen(name);
+    if(length > sizeof(slot->cs_name)){
+        return 0;
+    }
+    memcpy(slot->cs_name, name, length);
+    memset(slot->cs_name+length, ' ', sizeof(slot->cs_name)-length);
+    return 1;
+}
+
+int catalogCompareSlots(const void *left, const void *right){
+    /**
+     * Order name slots by name, then record position
+     * :param left: Name slot
+     * :param right: Name slot
+     * :return: Negative, zero or positive like memcmp
+     */
+    return memcmp(left, right, sizeof(catalogSlotStruct));
+}
@@ -0,0 +1,141 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLASSIFY_X86 1
+#endif
+
+
+#define CLASSIFY_CHUNK_SIZE (1 << 16)
+
+
+/* Text bytes are those isalnum, isspace or ispunct accept in the C locale:
+   printable ASCII 0x20-0x7e and the whitespace controls 0x09-0x0d. */
+
+size_t classifyTextScalar(const unsigned char *buffer, size_t count);
+#ifdef CLASSIFY_X86
+size_t classifyTextSse2(const unsigned char *buffer, size_t count);
+size_t classifyTextAvx2(const unsigned char *buffer, size_t count);
+#endif
+bool classifyIsText(const void *buffer, size_t count);
+bool classifyIsTextFile(int fd);
+
+
+size_t classifyTextScalar(const unsigned char *buffer, size_t count){
+    /**
+     * Length of text prefix of buffer, one byte at a time
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Position of first non-text byte, count if all text
+     */
+    for(size_t i=0; i < count; i++){
+        unsigned char c = buffer[i];
+        if((unsigned char)(c-0x20) > 0x5e && (unsigned char)(c-0x09) > 0x04){
+            return i;
+        }
+    }
+    return count;
+}
+
+#ifdef CLASSIFY_X86
+__attribute__((target("sse2")))
+size_t classifyTextSse2(const unsigned char *buffer, size_t count){
+    /**
+     * Length of text prefix of buffer, 16 bytes at a time
+     * Bytes from 0x80 compare as negative, so signed bounds reject them
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Position of first non-text byte, count if all text
+     */
+    const __m128i printableLow = _mm_set1_epi8(0x1f);
+    const __m128i printableHigh = _mm_set1_epi8(0x7f);
+    const __m128i spaceLow = _mm_set1_epi8(0x08);
+    const __m128i spaceHigh = _mm_set1_epi8(0x0e);
+    size_t i = 0;
+    for(; i+16 <= count; i+=16){
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(buffer+i));
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, printableLow), _mm_cmplt_epi8(bytes, printableHigh));
+        __m128i space = _mm_and_si128(_mm_cmpgt_epi8(bytes, spaceLow), _mm_cmplt_epi8(bytes, spaceHigh));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(printable, space));
+        if(mask != 0xffff){
+            return i+__builtin_ctz(~mask);
+        }
+    }
+    return i+classifyTextScalar(buffer+i, count-i);
+}
+
+__attribute__((target("avx2")))
+size_t classifyTextAvx2(const unsigned char *buffer, size_t count){
+    /**
+     * Length of text prefix of buffer, 32 bytes at a time
+     * Bytes from 0x80 compare as negative, so signed bounds reject them
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Position of first non-text byte, count if all text
+     */
+    const __m256i printableLow = _mm256_set1_epi8(0x1f);
+    const __m256i printableHigh = _mm256_set1_epi8(0x7f);
+    const __m256i spaceLow = _mm256_set1_epi8(0x08);
+    const __m256i spaceHigh = _mm256_set1_epi8(0x0e);
+    size_t i = 0;
+    for(; i+32 <= count; i+=32){
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(buffer+i));
+        __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, printableLow), _mm256_cmpgt_epi8(printableHigh, bytes));
+        __m256i space = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, spaceLow), _mm256_cmpgt_epi8(spaceHigh, bytes));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(printable, space));
+        if(mask != 0xffffffffU){
+            return i+__builtin_ctz(~mask);
+        }
+    }
+    return i+classifyTextSse2(buffer+i, count-i);
+}
+#endif
+
+bool classifyIsText(const void *buffer, size_t count){
+    /**
+     * Buffer holds only text bytes
+     * Uses the widest vector unit the CPU supports, SSE2 is not assumed
+     * on i386
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Is text
+     */
+#ifdef CLASSIFY_X86
+    if(__builtin_cpu_supports("avx2")){
+        return classifyTextAvx2(buffer, count) == count;
+    }
+    if(__builtin_cpu_supports("sse2")){
+        return classifyTextSse2(buffer, count) == count;
+    }
+#endif
+    return classifyTextScalar(buffer, count) == count;
+}
+
+bool classifyIsTextFile(int fd){
+    /**
+     * On-disk file holds only text bytes
+     * Reads in chunks and stops at the first chunk with a non-text byte
+     * :param fd: On-disk file open file descriptor
+     * :return: Is text, false if the file cannot be read
+     */
+    char *buffer = malloc(CLASSIFY_CHUNK_SIZE);
+    off_t offset = 0;
+    bool isText = true;
+    while(isText){
+        ssize_t bytesRead = pread(fd, buffer, CLASSIFY_CHUNK_SIZE, offset);
+        if(bytesRead == -1 && errno == EINTR){
+            continue;
+        }else if(bytesRead == -1){
+            isText = false;
+        }else if(bytesRead == 0){
+            break;
+        }else{
+            isText = classifyIsText(buffer, bytesRead);
+            offset += bytesRead;
+        }
+    }
+    free(buffer);
+    return isText;
+}
@@ -3,12 +3,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
-#include <utime.h>
+#include "stats.h"
 #include "file.h"
+#include "reader.h"
+#include "writer.h"
+#include "arena.h"
+#include "index.h"
+#include "header.h"
+#include "catalog.h"
+#include "hash.h"
+#include "lz.h"
 
 
 #define AR_NAME_SIZE 16
@@ -18,56 +28,157 @@
 #define AR_MODE_SIZE 8
 #define AR_SIZE_SIZE 10
 #define AR_FMAG_SIZE 2
+#define DEQUE_INITIAL_CAPACITY 64
+#define DEQUE_STREAM_THRESHOLD (1 << 18) // larger unarchived files are streamed, not read into memory
+#define DEQUE_INPUT_SIZE (2*LZ_BLOCK_HEADER_SIZE+LZ_BLOCK_SIZE) // compressed body read-ahead, a whole block and the next block header
 
 
 typedef struct ar_hdr archivedFileHeaderStruct;
 
 typedef struct archivedFile{
-    archivedFileHeaderStruct *header;
-    char *body;
+    char name[AR_NAME_SIZE+1]; // see `archivedFileName`
+    unsigned char isDeleted; // tombstone left in the deque table until compaction
+    unsigned char isHashed; // hash holds the body content hash
+    unsigned char isCompressed; // body starts with an lz.h frame, AR_MODE_COMPRESSED in the header
+    int mode; // without AR_MODE_COMPRESSED
+    int uid;
+    int gid;
+    long date;
+    off_t size; // body bytes
+    off_t offset; // on-disk archive file offset of header, -1 if unarchived
+    off_t length; // on-disk archive file bytes of header, body and padding
+    uint64_t hash;
+    archivedFileHeaderStruct *header; // header as stored in the archive
+    char *body; // NULL while the body is only on-disk
+    int fd; // open on-disk unarchived file streamed in place of body, -1 if none
 }archivedFileStruct;
 
-typedef struct dequeNode{
-    archivedFileStruct *data;
-    struct dequeNode *next;
-    struct dequeNode *prev;
-}dequeNodeStruct;
-
 typedef struct deque{
-    dequeNodeStruct *front;
-    dequeNodeStruct *rear;
+    archivedFileStruct *members; // archived files in archive order, contiguous
+    size_t count; // archived files in table, tombstones included
+    size_t capacity;
+    size_t deletedCount; // tombstones in table
+    char *map;
+    size_t mapSize;
+    nameIndexStruct *index; // archived file name to table position
+    archivedFileStruct *catalog; // catalog member held apart from archived files
+    int fd; // open archive for lazy body reads, -1 if none
+    arenaStruct *arena; // owns the deque and the headers and bodies read from the archive
 }dequeStruct;
 
 
-void dequeAppendRear(dequeStruct *deque, archivedFileStruct *archivedFile);
+dequeStruct *dequeCreate(void);
+archivedFileStruct *dequeAppendRear(dequeStruct *deque, archivedFileHeaderStruct *header, off_t offset);
+void dequeCompact(dequeStruct *deque);
 void dequePrint(dequeStruct *deque);
 void dequePrintArNames(dequeStruct *deque);
 void dequePrintArName(dequeStruct *deque, char *filename);
 void dequeFree(dequeStruct *deque);
-void dequeNodeFree(dequeNodeStruct *dequeNode);
-dequeStruct *archiveToDequeStruct(char *pathname);
-archivedFileStruct *archivedFileToArchivedFileStruct(int fd);
-void dequeStructToArchive(dequeStruct *deque, char *pathname);
-void archivedFileStructToFile(archivedFileStruct *archivedFile);
+void archivedFileFree(archivedFileStruct *archivedFile);
+void archivedFileParseHeader(archivedFileStruct *archivedFile, archivedFileHeaderStruct *header, off_t offset);
+dequeStruct *archiveToHeaderDequeStruct(char *pathname);
+dequeStruct *archiveToMappedDequeStruct(char *pathname, int advice);
+dequeStruct *archiveToCatalogDequeStruct(char *pathname);
+dequeStruct *archiveToCatalogNamesDequeStruct(char *pathname, char **names, size_t count);
+int archiveCatalogOpen(char *pathname, size_t *bodySize, size_t *count, off_t *endOffset);
+void dequeAppendCatalogTail(dequeStruct *deque, char *pathname, off_t endOffset);
+void dequeReadCatalog(dequeStruct *deque, void *destination, size_t count, off_t offset);
+void dequeAppendArchiveHeaders(dequeStruct *deque, readerStruct *reader);
+void dequeCheckHeader(dequeStruct *deque, archivedFileStruct *archivedFile, off_t offset);
+readerStruct *archiveReaderOpen(char *pathname);
+archivedFileStruct *archivedFileHeaderToArchivedFileStruct(dequeStruct *deque, readerStruct *reader);
+void archivedFileSkipPadding(readerStruct *reader);
+void dequeStructToArchive(dequeStruct *deque, char *pathname, int isCataloged);
+void dequeStructCompactArchive(dequeStruct *deque, char *pathname);
+char *dequeStructToCatalogBody(dequeStruct *deque, size_t bodySize, off_t endOffset);
+void dequeStructRefreshCatalog(dequeStruct *deque);
+void archivedFileStructToArchive(archivedFileStruct *archivedFile, writerStruct *writer);
+void archivedFileStructToFile(dequeStruct *deque, archivedFileStruct *archivedFile);
 void archivedFileStructPrintVerbose(archivedFileStruct *archivedFile);
 char *monthName(int month);
-void dequeStructAppendArchivedFile(dequeStruct *deque, char *pathname);
+void archivedFileName(archivedFileStruct *archivedFile, char *name);
+archivedFileStruct *fileToArchivedFileStruct(char *pathname, int isCompressed);
+archivedFileStruct *statToArchivedFileStruct(char *pathname, struct stat *filedata);
+void archivedFileCompress(archivedFileStruct *archivedFile);
+int archivedFileFrame(dequeStruct *deque, archivedFileStruct *archivedFile, uint64_t *size, uint64_t *hash);
+void archivedFileDecompress(dequeStruct *deque, archivedFileStruct *archivedFile, writerStruct *writer, uint64_t size, uint64_t hash);
+int archivedFileReadBody(dequeStruct *deque, archivedFileStruct *archivedFile, off_t offset, void *buffer, size_t count);
 void dequeStructDeleteArchivedFile(dequeStruct *deque, char *pathname);
+int dequeStructHasArchivedFile(dequeStruct *deque, archivedFileStruct *archivedFile);
+int dequeStructHasUnchangedFile(dequeStruct *deque, char *name, struct stat *filedata);
+uint64_t archivedFileHash(dequeStruct *deque, archivedFileStruct *archivedFile);
+
+
+dequeStruct *dequeCreate(void){
+    /**
+     * Create empty deque, a growable table of archived files
+     * Headers and bodies read into the deque are allocated from its arena
+     * :return: Deque data structure
+     */
+    arenaStruct *arena = arenaCreate();
+    dequeStruct *deque = arenaAlloc(arena, sizeof(dequeStruct));
+    deque->capacity = DEQUE_INITIAL_CAPACITY;
+    deque->members = malloc(deque->capacity*sizeof(archivedFileStruct));
+    deque->count = 0;
+    deque->deletedCount = 0;
+    deque->map = NULL;
+    deque->mapSize = 0;
+    deque->index = nameIndexCreate(arena);
+    deque->catalog = NULL;
+    deque->fd = -1;
+    deque->arena = arena;
+    return deque;
+}
+
+archivedFileStruct *dequeAppendRear(dequeStruct *deque, archivedFileHeaderStruct *header, off_t offset){
+    /**
+     * Deque append archived file to end of table
+     * A catalog member at the front of the archive is held apart instead
+     * :param deque: Deque data structure
+     * :param header: Archived file header, must outlive the deque
+     * :param offset: On-disk archive file offset of header
+     * :return: Archived file with NULL body, valid until the next append
+     */
+    if(offset == SARMAG && catalogIsHeader(header)){
+        deque->catalog = arenaAlloc(deque->arena, sizeof(archivedFileStruct));
+        archivedFileParseHeader(deque->catalog, header, offset);
+        return deque->catalog;
+    }
 
+    if(deque->count == deque->capacity){
+        deque->capacity *= 2;
+        deque->members = realloc(deque->members, deque->capacity*sizeof(archivedFileStruct));
+    }
+    archivedFileStruct *archivedFile = &deque->members[deque->count];
+    archivedFileParseHeader(archivedFile, header, offset);
+    statsCount(&stats.members, NULL, 0);
+    nameIndexInsert(deque->index, archivedFile->name, deque->count);
+    deque->count++;
+    return archivedFile;
+}
 
-void dequeAppendRear(dequeStruct *deque, archivedFileStruct *archivedFile){
+void dequeCompact(dequeStruct *deque){
     /**
-     * Deque append rear node
+     * Remove tombstones from the deque table and reindex it
      * :param deque: Deque data structure
-     * :param archivedFile: Deque node data
      * :return: None
      */
-    dequeNodeStruct *dequeNode = malloc(sizeof(dequeNodeStruct));
-    dequeNode->data = archivedFile;
-    dequeNode->next = deque->rear;
-    dequeNode->prev = deque->rear->prev;
-    deque->rear->prev->next = dequeNode;
-    deque->rear->prev = dequeNode;
+    if(deque->deletedCount == 0){
+        return;
+    }
+    size_t count = 0;
+    for(size_t i=0; i < deque->count; i++){
+        if(!deque->members[i].isDeleted){
+            deque->members[count++] = deque->members[i];
+        }
+    }
+    deque->count = count;
+    deque->deletedCount = 0;
+    nameIndexFree(deque->index);
+    deque->index = nameIndexCreate(deque->arena);
+    for(size_t i=0; i < deque->count; i++){
+        nameIndexInsert(deque->index, deque->members[i].name, i);
+    }
 }
 
 void dequePrint(dequeStruct *deque){
@@ -76,17 +187,18 @@ void dequePrint(dequeStruct *deque){
      * :param deque: Deque data structure
      * :return: None
      */
-    dequeNodeStruct *cur = deque->front->next;
-    while(cur->next != NULL){
-        printf("\"%s\"\n", cur->data->header->ar_name);
-        printf("\"%s\"\n", cur->data->header->ar_date);
-        printf("\"%s\"\n", cur->data->header->ar_uid);
-        printf("\"%s\"\n", cur->data->header->ar_gid);
-        printf("\"%s\"\n", cur->data->header->ar_mode);
-        printf("\"%s\"\n", cur->data->header->ar_size);
-        printf("\"%s\"\n", cur->data->header->ar_fmag);
-        printf("\"%s\"\n", cur->data->body);
-        cur = cur->next;
+    for(size_t i=0; i < deque->count; i++){
+        archivedFileStruct *archivedFile = &deque->members[i];
+        if(archivedFile->isDeleted){
+            continue;
+        }
+        printf("\"%s\"\n", archivedFile->name);
+        printf("\"%ld\"\n", archivedFile->date);
+        printf("\"%d\"\n", archivedFile->uid);
+        printf("\"%d\"\n", archivedFile->gid);
+        printf("\"%d\"\n", archivedFile->mode);
+        printf("\"%lld\"\n", (long long)archivedFile->size);
+        printf("\"%.*s\"\n", (int)archivedFile->size, archivedFile->body);
     }
 }
 
@@ -96,351 +208,724 @@ void dequePrintArNames(dequeStruct *deque){
      * :param deque: Archive structured data deque
      * :return: None
      */
-    dequeNodeStruct *cur = deque->front->next;
-    while(cur->next != NULL){
-        printf("%s\n", cur->data->header->ar_name);
-        cur = cur->next;
+    for(size_t i=0; i < deque->count; i++){
+        if(!deque->members[i].isDeleted){
+            printf("%s\n", deque->members[i].name);
+        }
     }
 }
 
 void dequePrintArName(dequeStruct *deque, char *filename){
     /**
-     * Print deque data structure matching filename ar_name to terminal
+     * Print deque data structure matching filename ar_names to terminal
      * :param deque: Archived structured data deque
      * :param filename: Filename ar_name to match
      * :return: None
      */
-    dequeNodeStruct *cur = deque->front->next;
-    while(cur->next != NULL){
-        if(strncmp(cur->data->header->ar_name, filename, strlen(filename)) == 0){
-            printf("%s\n", cur->data->header->ar_name);
-            break;
-        }
-        cur = cur->next;
+    nameIndexEntryStruct *entry = nameIndexFind(deque->index, filename);
+    while(entry != NULL){
+        printf("%s\n", deque->members[entry->position].name);
+        entry = nameIndexFindNext(entry);
     }
 }
 
 void dequeFree(dequeStruct *deque){
     /**
-     * Free deque data structure heap memory
+     * Free deque table and release its arena
      * :param deque: Deque data structure
      * :return: None
      */
-    dequeNodeStruct *cur = deque->front;
-    dequeNodeStruct *next = cur->next;
-    while(cur != NULL){
-        if(cur->data != NULL){
-            archivedFileStruct *archivedFile = cur->data;
-            free(archivedFile->header);
-            free(archivedFile->body);
-            free(archivedFile);
-        }
-        free(cur);
-        cur = next;
-        if(cur != NULL){
-            next = cur->next;
-        }
+    if(deque->map != NULL){
+        munmap(deque->map, deque->mapSize);
+    }
+    nameIndexFree(deque->index);
+    if(deque->fd >= 0){
+        close(deque->fd);
     }
-    free(deque);
+    free(deque->members);
+    arenaFree(deque->arena);
 }
 
-void dequeNodeFree(dequeNodeStruct *dequeNode){
+void archivedFileFree(archivedFileStruct *archivedFile){
     /**
-     * Free deque node data structure heap memory
-     * :param dequeNode: Deque node data structure
+     * Free unarchived file structured data heap memory
+     * Archived files read into a deque are released with its arena instead
+     * :param archivedFile: Unarchived file structured data
      * :return: None
      */
-    free(dequeNode->data->header);
-    free(dequeNode->data->body);
-    free(dequeNode->data);
-    free(dequeNode);
+    if(archivedFile->fd >= 0){
+        close(archivedFile->fd);
+    }
+    free(archivedFile->header);
+    free(archivedFile->body);
+    free(archivedFile);
 }
 
-dequeStruct *archiveToDequeStruct(char *pathname){
+void archivedFileParseHeader(archivedFileStruct *archivedFile, archivedFileHeaderStruct *header, off_t offset){
     /**
-     * Read on-disk file to structured data deque
+     * Fill archived file name and numeric metadata from its header
+     * :param archivedFile: Destination archived file structured data
+     * :param header: Archived file header
+     * :param offset: On-disk archive file offset of header, -1 if unarchived
+     * :return: None
+     */
+    int64_t mode = 0, uid = 0, gid = 0, date = 0, size = 0;
+    if(!headerParseField(header->ar_size, AR_SIZE_SIZE, HEADER_DECIMAL, &size)){ // Error handling
+        fprintf(stderr, "Error: Cannot read header from archive\n");
+        exit(EXIT_FAILURE);
+    }
+    headerParseMode(header->ar_mode, AR_MODE_SIZE, &mode);
+    headerParseField(header->ar_uid, AR_UID_SIZE, HEADER_DECIMAL, &uid);
+    headerParseField(header->ar_gid, AR_GID_SIZE, HEADER_DECIMAL, &gid);
+    headerParseField(header->ar_date, AR_DATE_SIZE, HEADER_DECIMAL, &date);
+
+    archivedFile->header = header;
+    archivedFileName(archivedFile, archivedFile->name);
+    archivedFile->isDeleted = 0;
+    archivedFile->isHashed = 0;
+    archivedFile->isCompressed = (mode & AR_MODE_COMPRESSED) != 0;
+    archivedFile->mode = mode & ~AR_MODE_COMPRESSED;
+    archivedFile->uid = uid;
+    archivedFile->gid = gid;
+    archivedFile->date = date;
+    archivedFile->size = size;
+    archivedFile->offset = offset;
+    archivedFile->length = sizeof(archivedFileHeaderStruct);
+    archivedFile->hash = 0;
+    archivedFile->body = NULL;
+    archivedFile->fd = -1;
+}
+
+dequeStruct *archiveToHeaderDequeStruct(char *pathname){
+    /**
+     * Read on-disk file headers to structured data deque
+     * Archived file bodies are skipped and left NULL
      * :param pathname: On-disk file path
      * :return: Deque data structure
      */
-    int fd = openFileReadOnly(pathname);
+    statsPhase(STATS_PARSE);
+    readerStruct *reader = archiveReaderOpen(pathname);
 
     // Create deque
-    dequeNodeStruct *front = malloc(sizeof(dequeNodeStruct));
-    dequeNodeStruct *rear = malloc(sizeof(dequeNodeStruct));
-    front->data = NULL;
-    front->next = rear;
-    front->prev = NULL;
-    rear->data = NULL;
-    rear->next = NULL;
-    rear->prev = front;
-    dequeStruct *deque = malloc(sizeof(dequeStruct));
-    deque->front = front;
-    deque->rear = rear;
+    dequeStruct *deque = dequeCreate();
 
     // Fill deque
-    int endOffset = lseek(fd, 0, SEEK_END);
-    lseek(fd, SARMAG, SEEK_SET);
-    int curOffset = lseek(fd, 0, SEEK_CUR);
-    while(curOffset < endOffset-1){
-        archivedFileStruct *archivedFile = archivedFileToArchivedFileStruct(fd);
-        dequeAppendRear(deque, archivedFile);
-        curOffset = lseek(fd, 0, SEEK_CUR);
+    dequeAppendArchiveHeaders(deque, reader);
+
+    readerClose(reader);
+    statsPhase(STATS_MUTATE);
+    return deque;
+}
+
+void dequeAppendArchiveHeaders(dequeStruct *deque, readerStruct *reader){
+    /**
+     * Deque append archived file headers from reader offset to end of archive
+     * Archived file bodies are skipped and left NULL
+     * :param deque: Deque data structure
+     * :param reader: On-disk archive file buffered reader at a header
+     * :return: None
+     */
+    while(readerOffset(reader) < reader->size-1){
+        archivedFileStruct *archivedFile = archivedFileHeaderToArchivedFileStruct(deque, reader);
+        readerSkip(reader, archivedFile->size);
+        archivedFileSkipPadding(reader);
+        archivedFile->length = readerOffset(reader)-archivedFile->offset;
     }
+}
 
-    close(fd);
+dequeStruct *archiveToCatalogDequeStruct(char *pathname){
+    /**
+     * Read on-disk file headers from its catalog member to structured data deque
+     * Archived files appended after the catalog was written are scanned
+     * Archived file bodies are left NULL, see `dequeLoadBody`
+     * :param pathname: On-disk file path
+     * :return: Deque data structure, NULL if the archive has no usable catalog
+     */
+    statsPhase(STATS_PARSE);
+    size_t bodySize, count;
+    off_t endOffset;
+    int fd = archiveCatalogOpen(pathname, &bodySize, &count, &endOffset);
+    if(fd == -1){
+        return NULL;
+    }
+
+    // Create deque and read catalog member
+    dequeStruct *deque = dequeCreate();
+    deque->fd = fd;
+    archivedFileHeaderStruct *catalogHeader = arenaAlloc(deque->arena, sizeof(archivedFileHeaderStruct));
+    char *body = arenaAlloc(deque->arena, bodySize);
+    if(pread(fd, catalogHeader, sizeof(archivedFileHeaderStruct), SARMAG) != sizeof(archivedFileHeaderStruct) ||
+            pread(fd, body, bodySize, SARMAG+sizeof(archivedFileHeaderStruct)) != (ssize_t)bodySize){
+        dequeFree(deque);
+        return NULL;
+    }
+    archivedFileStruct *catalog = dequeAppendRear(deque, catalogHeader, SARMAG);
+    catalog->body = body;
+    catalog->length = sizeof(archivedFileHeaderStruct)+bodySize+bodySize%2;
+
+    // Fill deque from catalog records, headers are views into the catalog body
+    for(size_t i=0; i < count; i++){
+        catalogRecordStruct *record = catalogRecord(body, i);
+        off_t offset = catalogParseField(record->cr_offset, sizeof(record->cr_offset));
+        archivedFileStruct *archivedFile = dequeAppendRear(deque, &record->cr_hdr, offset);
+        off_t nextOffset = i+1 < count ? catalogParseField(catalogRecord(body, i+1)->cr_offset, sizeof(record->cr_offset)) : endOffset;
+        archivedFile->length = nextOffset-archivedFile->offset;
+        archivedFile->isHashed = catalogRecordHash(record, &archivedFile->hash);
+    }
+
+    // Fill deque from archived files appended since
+    dequeAppendCatalogTail(deque, pathname, endOffset);
+    statsPhase(STATS_MUTATE);
     return deque;
 }
 
-archivedFileStruct *archivedFileToArchivedFileStruct(int fd){
+dequeStruct *archiveToCatalogNamesDequeStruct(char *pathname, char **names, size_t count){
     /**
-     * Read on-disk archived file to structured data deque
-     * Helper function to `archiveToDequeStruct`
-     * :param fd: On-disk archived file open file descriptor
-     * :return: Archived file structured data deque
+     * Read headers of named on-disk archived files through the catalog member
+     * Each name is a binary search of preads over the catalog's sorted name
+     * slots, so the rest of the catalog is never read. Archived files
+     * appended after the catalog was written are scanned
+     * :param pathname: On-disk file path
+     * :param names: Archived file names
+     * :param count: Archived file names count
+     * :return: Deque of the cataloged archived files of each name in archive
+     * order, then the appended archived files, NULL if the archive has no
+     * usable catalog
      */
-    // Create archivedFile
-    archivedFileHeaderStruct *header = malloc(sizeof(archivedFileHeaderStruct));
-    archivedFileStruct *archivedFile = malloc(sizeof(archivedFileStruct));
-    archivedFile->header = header;
-    archivedFile->body = NULL;
+    statsPhase(STATS_PARSE);
+    size_t bodySize, recordCount;
+    off_t endOffset;
+    int fd = archiveCatalogOpen(pathname, &bodySize, &recordCount, &endOffset);
+    if(fd == -1){
+        return NULL;
+    }
+    dequeStruct *deque = dequeCreate();
+    deque->fd = fd;
+    off_t bodyOffset = SARMAG+sizeof(archivedFileHeaderStruct);
 
-    // Fill archivedFile
-    char *buffer;
-    int bytesRead;
+    for(size_t i=0; i < count; i++){
+        catalogSlotStruct key, slot;
+        if(nameIndexFind(deque->index, names[i]) != NULL || !catalogSlotName(&key, names[i])){ // Repeated or too long
+            continue;
+        }
 
-    // Read archived file name
-    buffer = malloc(AR_NAME_SIZE);
-    memset(buffer, '\0', AR_NAME_SIZE);
-    bytesRead = read(fd, buffer, AR_NAME_SIZE);
-    if(bytesRead != AR_NAME_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_name from archive\n");
-        exit(EXIT_FAILURE);
+        // First slot of the name
+        size_t low = 0, high = recordCount;
+        while(low < high){
+            size_t middle = low+(high-low)/2;
+            dequeReadCatalog(deque, &slot, sizeof(slot), bodyOffset+catalogSlotOffset(bodySize, middle));
+            if(memcmp(slot.cs_name, key.cs_name, sizeof(key.cs_name)) < 0){
+                low = middle+1;
+            }else{
+                high = middle;
+            }
+        }
+
+        // Records of the name, in archive order
+        for(size_t j=low; j < recordCount; j++){
+            dequeReadCatalog(deque, &slot, sizeof(slot), bodyOffset+catalogSlotOffset(bodySize, j));
+            if(memcmp(slot.cs_name, key.cs_name, sizeof(key.cs_name)) != 0){
+                break;
+            }
+            int64_t position = catalogParseField(slot.cs_record, sizeof(slot.cs_record));
+            if(position < 0 || (size_t)position >= recordCount){ // Error handling
+                fprintf(stderr, "Error: Cannot read catalog from archive\n");
+                exit(EXIT_FAILURE);
+            }
+            catalogRecordStruct *record = arenaAlloc(deque->arena, sizeof(catalogRecordStruct));
+            dequeReadCatalog(deque, record, sizeof(catalogRecordStruct), bodyOffset+catalogRecordOffset(position));
+            off_t offset = catalogParseField(record->cr_offset, sizeof(record->cr_offset));
+            archivedFileStruct *archivedFile = dequeAppendRear(deque, &record->cr_hdr, offset);
+            archivedFile->length = sizeof(archivedFileHeaderStruct)+archivedFile->size+archivedFile->size%2;
+            archivedFile->isHashed = catalogRecordHash(record, &archivedFile->hash);
+        }
     }
-    buffer[AR_NAME_SIZE-1] = '\0';
-    memcpy(header->ar_name, buffer, AR_NAME_SIZE);
-    free(buffer);
 
-    // Read archived file date
-    buffer = malloc(AR_DATE_SIZE);
-    memset(buffer, '\0', AR_DATE_SIZE);
-    bytesRead = read(fd, buffer, AR_DATE_SIZE);
-    if(bytesRead != AR_DATE_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_date from archive\n");
-        exit(EXIT_FAILURE);
+    // Fill deque from archived files appended since
+    dequeAppendCatalogTail(deque, pathname, endOffset);
+    statsPhase(STATS_MUTATE);
+    return deque;
+}
+
+int archiveCatalogOpen(char *pathname, size_t *bodySize, size_t *count, off_t *endOffset){
+    /**
+     * Open on-disk archive led by a catalog member that still matches it
+     * The last record must end where the catalog says, its header must still
+     * be at its offset and anything past the end must start with a header,
+     * so a catalog left stale by another ar is not trusted
+     * :param pathname: On-disk file path
+     * :param bodySize: Destination of catalog member body size
+     * :param count: Destination of catalog records in use
+     * :param endOffset: Destination of archive file offset covered by the records
+     * :return: Open archive, -1 if the archive has no usable catalog
+     */
+    int fd = openFileReadOnly(pathname);
+    struct stat filedata;
+    fstat(fd, &filedata);
+
+    // Read archive indicator, catalog header and preamble
+    char buffer[SARMAG+sizeof(archivedFileHeaderStruct)+sizeof(catalogPreambleStruct)];
+    archivedFileHeaderStruct *header = (archivedFileHeaderStruct *)(buffer+SARMAG);
+    int64_t size = 0;
+    if(pread(fd, buffer, sizeof(buffer), 0) != sizeof(buffer) || memcmp(buffer, ARMAG, SARMAG) != 0 || !catalogIsHeader(header) ||
+            !headerParseField(header->ar_size, AR_SIZE_SIZE, HEADER_DECIMAL, &size) || size <= 0 ||
+            !catalogReadPreamble(buffer+SARMAG+sizeof(archivedFileHeaderStruct), size, count, endOffset) || *endOffset > filedata.st_size){
+        close(fd);
+        return -1;
     }
-    buffer[AR_DATE_SIZE-1] = '\0';
-    memcpy(header->ar_date, buffer, AR_DATE_SIZE);
-    free(buffer);
+    *bodySize = size;
 
-    // Read archived file uid
-    buffer = malloc(AR_UID_SIZE);
-    memset(buffer, '\0', AR_UID_SIZE);
-    bytesRead = read(fd, buffer, AR_UID_SIZE);
-    if(bytesRead != AR_UID_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_uid from archive\n");
-        exit(EXIT_FAILURE);
+    // Confirm the records still describe the archive
+    off_t recordsEnd = SARMAG+sizeof(archivedFileHeaderStruct)+size+size%2;
+    archivedFileHeaderStruct onDisk;
+    if(*count > 0){
+        catalogRecordStruct record;
+        int64_t last = -1, lastSize = -1;
+        if(pread(fd, &record, sizeof(record), SARMAG+sizeof(archivedFileHeaderStruct)+catalogRecordOffset(*count-1)) == sizeof(record)){
+            last = catalogParseField(record.cr_offset, sizeof(record.cr_offset));
+            headerParseField(record.cr_hdr.ar_size, AR_SIZE_SIZE, HEADER_DECIMAL, &lastSize);
+        }
+        recordsEnd = last+sizeof(archivedFileHeaderStruct)+lastSize+lastSize%2;
+        if(last < 0 || lastSize < 0 || pread(fd, &onDisk, sizeof(onDisk), last) != sizeof(onDisk) ||
+                memcmp(&onDisk, &record.cr_hdr, sizeof(onDisk)) != 0){
+            recordsEnd = -1;
+        }
+    }
+    if(recordsEnd != *endOffset || (*endOffset < filedata.st_size &&
+            (pread(fd, &onDisk, sizeof(onDisk), *endOffset) != sizeof(onDisk) || memcmp(onDisk.ar_fmag, ARFMAG, AR_FMAG_SIZE) != 0))){
+        close(fd);
+        return -1;
     }
-    buffer[AR_UID_SIZE-1] = '\0';
-    memcpy(header->ar_uid, buffer, AR_UID_SIZE);
-    free(buffer);
+    return fd;
+}
+
+void dequeAppendCatalogTail(dequeStruct *deque, char *pathname, off_t endOffset){
+    /**
+     * Deque append archived file headers past the end of the catalog records
+     * :param deque: Deque data structure with open archive
+     * :param pathname: On-disk archive file path
+     * :param endOffset: Archive file offset covered by the catalog records
+     * :return: None
+     */
+    struct stat filedata;
+    fstat(deque->fd, &filedata);
+    if(endOffset < filedata.st_size){ // Archive indicator was checked with the catalog
+        readerStruct *reader = readerOpen(pathname);
+        readerSkip(reader, endOffset);
+        dequeAppendArchiveHeaders(deque, reader);
+        readerClose(reader);
+    }
+}
 
-    // Read archived file gid
-    buffer = malloc(AR_GID_SIZE);
-    memset(buffer, '\0', AR_GID_SIZE);
-    bytesRead = read(fd, buffer, AR_GID_SIZE);
-    if(bytesRead != AR_GID_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_gid from archive\n");
+void dequeReadCatalog(dequeStruct *deque, void *destination, size_t count, off_t offset){
+    /**
+     * Read range of the catalog member from the open archive
+     * :param deque: Deque data structure with open archive
+     * :param destination: Destination buffer
+     * :param count: Bytes to read
+     * :param offset: Archive file offset
+     * :return: None
+     */
+    if(pread(deque->fd, destination, count, offset) != (ssize_t)count){ // Error handling
+        fprintf(stderr, "Error: Cannot read catalog from archive\n");
         exit(EXIT_FAILURE);
     }
-    buffer[AR_GID_SIZE-1] = '\0';
-    memcpy(header->ar_gid, buffer, AR_GID_SIZE);
-    free(buffer);
+}
 
-    // Read archived file mode
-    buffer = malloc(AR_MODE_SIZE);
-    memset(buffer, '\0', AR_MODE_SIZE);
-    bytesRead = read(fd, buffer, AR_MODE_SIZE);
-    if(bytesRead != AR_MODE_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_mode from archive\n");
+void dequeCheckHeader(dequeStruct *deque, archivedFileStruct *archivedFile, off_t offset){
+    /**
+     * Confirm archived file header is still at its offset in the open archive
+     * Catches catalogs left stale by other ar implementations
+     * :param deque: Deque data structure with open archive
+     * :param archivedFile: Archived file structured data
+     * :param offset: On-disk archive file offset of header
+     * :return: None
+     */
+    archivedFileHeaderStruct header;
+    if(pread(deque->fd, &header, sizeof(archivedFileHeaderStruct), offset) != sizeof(archivedFileHeaderStruct)){
+        fprintf(stderr, "Error: Cannot read header from archive\n");
         exit(EXIT_FAILURE);
     }
-    buffer[AR_MODE_SIZE-1] = '\0';
-    memcpy(header->ar_mode, buffer, AR_MODE_SIZE);
-    free(buffer);
+    if(memcmp(&header, archivedFile->header, sizeof(archivedFileHeaderStruct)) != 0){
+        fprintf(stderr, "Error: Stale catalog in archive, rebuild it with -s\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
-    // Read archived file size
-    buffer = malloc(AR_SIZE_SIZE);
-    memset(buffer, '\0', AR_SIZE_SIZE);
-    bytesRead = read(fd, buffer, AR_SIZE_SIZE);
-    if(bytesRead != AR_SIZE_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_size from archive\n");
+readerStruct *archiveReaderOpen(char *pathname){
+    /**
+     * Open on-disk archive file for buffered reads past its archive indicator
+     * :param pathname: On-disk archive file path
+     * :return: Buffered reader
+     */
+    readerStruct *reader = readerOpen(pathname);
+    char buffer[SARMAG];
+    if(readerRead(reader, buffer, SARMAG) != SARMAG || memcmp(buffer, ARMAG, SARMAG) != 0){
+        fprintf(stderr, "Error: Non-archive file \"%s\"\n", pathname);
         exit(EXIT_FAILURE);
     }
-    buffer[AR_SIZE_SIZE-1] = '\0';
-    memcpy(header->ar_size, buffer, AR_SIZE_SIZE);
-    free(buffer);
+    return reader;
+}
+
+dequeStruct *archiveToMappedDequeStruct(char *pathname, int advice){
+    /**
+     * Map on-disk file to structured data deque
+     * Archived file headers and bodies are views into the mapping
+     * :param pathname: On-disk file path
+     * :param advice: madvise access pattern hint for the mapping
+     * :return: Deque data structure, NULL if the file cannot be mapped
+     */
+    statsPhase(STATS_PARSE);
+    int fd = openFileReadOnly(pathname);
+    struct stat filedata;
+    fstat(fd, &filedata);
+    size_t endOffset = filedata.st_size;
+    char *map = NULL;
+    if(S_ISREG(filedata.st_mode) && endOffset > 0){
+        map = mmap(NULL, endOffset, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(map == NULL || map == MAP_FAILED){
+        return NULL;
+    }
+    madvise(map, endOffset, advice);
 
-    // Read archived file fmag
-    buffer = malloc(AR_FMAG_SIZE);
-    memset(buffer, '\0', AR_FMAG_SIZE);
-    bytesRead = read(fd, buffer, AR_FMAG_SIZE);
-    if(bytesRead != AR_FMAG_SIZE){
-        fprintf(stderr, "Error: Cannot read ar_fmag from archive\n");
+    // Confirm archive indicator
+    if(endOffset < SARMAG || memcmp(map, ARMAG, SARMAG) != 0){
+        fprintf(stderr, "Error: Non-archive file \"%s\"\n", pathname);
         exit(EXIT_FAILURE);
     }
-    memcpy(header->ar_fmag, buffer, AR_FMAG_SIZE);
-    free(buffer);
 
-    // Read archived file body
-    int ar_size;
-    sscanf(header->ar_size, "%d", &ar_size);
-    buffer = malloc(ar_size);
-    bytesRead = read(fd, buffer, ar_size);
-    if(bytesRead != ar_size){
-        fprintf(stderr, "Error: Cannot read body from archive\n");
+    // Create deque
+    dequeStruct *deque = dequeCreate();
+    deque->map = map;
+    deque->mapSize = endOffset;
+
+    // Fill deque
+    size_t curOffset = SARMAG;
+    while(curOffset+1 < endOffset){
+        if(curOffset+sizeof(archivedFileHeaderStruct) > endOffset){
+            fprintf(stderr, "Error: Cannot read header from archive\n");
+            exit(EXIT_FAILURE);
+        }
+        archivedFileStruct *archivedFile = dequeAppendRear(deque, (archivedFileHeaderStruct *)(map+curOffset), curOffset);
+        curOffset += sizeof(archivedFileHeaderStruct);
+
+        off_t ar_size = archivedFile->size;
+        if(ar_size < 0 || curOffset+ar_size > endOffset){
+            fprintf(stderr, "Error: Cannot read body from archive\n");
+            exit(EXIT_FAILURE);
+        }
+        archivedFile->body = map+curOffset;
+        curOffset += ar_size;
+        if(curOffset%2 == 1 && curOffset < endOffset && map[curOffset] == '\n'){ // Standard even padding
+            curOffset++;
+        }
+        archivedFile->length = curOffset-archivedFile->offset;
+    }
+
+    statsPhase(STATS_MUTATE);
+    return deque;
+}
+
+archivedFileStruct *archivedFileHeaderToArchivedFileStruct(dequeStruct *deque, readerStruct *reader){
+    /**
+     * Read on-disk archived file header to structured data deque
+     * Leaves the reader at the start of the archived file body
+     * :param deque: Deque data structure owning the archived file
+     * :param reader: On-disk archive file buffered reader
+     * :return: Archived file structured data deque with NULL body
+     */
+    off_t offset = readerOffset(reader);
+    archivedFileHeaderStruct *header = arenaAlloc(deque->arena, sizeof(archivedFileHeaderStruct));
+    if(readerRead(reader, header, sizeof(archivedFileHeaderStruct)) != sizeof(archivedFileHeaderStruct)){
+        fprintf(stderr, "Error: Cannot read header from archive\n");
         exit(EXIT_FAILURE);
     }
-    archivedFile->body = malloc(ar_size*sizeof(char));
-    memcpy(archivedFile->body, buffer, ar_size);
-    free(buffer);
+    return dequeAppendRear(deque, header, offset);
+}
 
-    return archivedFile;
+void archivedFileSkipPadding(readerStruct *reader){
+    /**
+     * Skip standard newline padding after odd sized archived file
+     * :param reader: On-disk archive file buffered reader
+     * :return: None
+     */
+    if(readerOffset(reader)%2 == 1 && readerPeek(reader) == '\n'){
+        readerSkip(reader, 1);
+    }
 }
 
-void dequeStructToArchive(dequeStruct *deque, char *pathname){
+void dequeStructToArchive(dequeStruct *deque, char *pathname, int isCataloged){
     /**
      * Write structured data deque to on-disk archive file
-     * :param deque: Archived structured data deque
+     * The new archive is written beside the original and renamed over it, so
+     * bodies left on-disk are streamed from the original in bounded memory
+     * :param deque: Archived structured data deque, with open archive if bodies are on-disk
      * :param pathname: On-disk archive file path
+     * :param isCataloged: Write a fresh catalog member first
      * :return: None
      */
-    int fd = openFileWriteOnlyTruncate(pathname);
-    int bytesWritten;
+    statsPhase(STATS_WRITE);
+    // Keep original offsets before the catalog reassigns them
+    dequeCompact(deque);
+    off_t *sources = malloc((deque->count > 0 ? deque->count : 1)*sizeof(off_t));
+    for(size_t i=0; i < deque->count; i++){
+        sources[i] = deque->members[i].offset;
+    }
+    if(isCataloged){
+        dequeStructRefreshCatalog(deque);
+    }
 
-    // Write archive indicator to archive
-    lseek(fd, 0, SEEK_SET);
-    bytesWritten = write(fd, ARMAG, SARMAG);
-    if(bytesWritten == -1){
-        fprintf(stderr, "Error: Cannot write archive indicator to file \"%s\"\n", pathname);
+    // Open new archive beside the original with its permissions
+    size_t temporarySize = strlen(pathname)+sizeof(".XXXXXX");
+    char *temporary = malloc(temporarySize);
+    if(temporary == NULL){ // Error handling
+        fprintf(stderr, "Error: Cannot create file beside \"%s\"\n", pathname);
         exit(EXIT_FAILURE);
     }
+    snprintf(temporary, temporarySize, "%s.XXXXXX", pathname);
+    int fd = mkstemp(temporary);
+    struct stat filedata;
+    if(fd == -1 || stat(pathname, &filedata) == -1 || fchmod(fd, filedata.st_mode & 07777) == -1){
+        fprintf(stderr, "Error: Cannot create file \"%s\"\n", temporary);
+        exit(EXIT_FAILURE);
+    }
+    writerStruct *writer = writerOpen(fd, temporary);
+
+    // Write archive indicator and catalog to archive
+    writerWrite(writer, ARMAG, SARMAG);
+    if(isCataloged){
+        archivedFileStructToArchive(deque->catalog, writer);
+    }
 
     // Write deque to archive
-    dequeNodeStruct *cur = deque->front->next;
-    while(cur->next != NULL){
-        // Write ar_name to archive
-        bytesWritten = write(fd, cur->data->header->ar_name, AR_NAME_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_name to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
+    for(size_t i=0; i < deque->count; i++){
+        archivedFileStruct *archivedFile = &deque->members[i];
+        if(archivedFile->body != NULL){
+            archivedFileStructToArchive(archivedFile, writer);
+            continue;
         }
-
-        // Write ar_date to archive
-        bytesWritten = write(fd, cur->data->header->ar_date, AR_DATE_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_date to file \"%s\"\n", pathname);
+        dequeCheckHeader(deque, archivedFile, sources[i]);
+        writerWrite(writer, archivedFile->header, sizeof(archivedFileHeaderStruct));
+        if(writerCopy(writer, deque->fd, sources[i]+sizeof(archivedFileHeaderStruct), archivedFile->size) != archivedFile->size){
+            fprintf(stderr, "Error: Cannot read body from archive\n");
             exit(EXIT_FAILURE);
         }
-
-        // Write ar_uid to archive
-        bytesWritten = write(fd, cur->data->header->ar_uid, AR_UID_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_uid to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
+        if(archivedFile->size%2 == 1){ // Standard even padding
+            writerWrite(writer, "\n", 1);
         }
+    }
 
-        // Write ar_gid to archive
-        bytesWritten = write(fd, cur->data->header->ar_gid, AR_GID_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_gid to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
-        }
+    writerClose(writer);
+    close(fd);
+    if(rename(temporary, pathname) == -1){
+        fprintf(stderr, "Error: Cannot replace file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    free(temporary);
+    free(sources);
+}
 
-        // Write ar_mode to archive
-        bytesWritten = write(fd, cur->data->header->ar_mode, AR_MODE_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_mode to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
-        }
+void dequeStructCompactArchive(dequeStruct *deque, char *pathname){
+    /**
+     * Compact on-disk archive file in place down to the deque's archived files
+     * Archived files before the first removed one are left untouched, later
+     * ones are shifted down over the gaps and the archive is truncated
+     * :param deque: Archived structured data deque read from the archive
+     * :param pathname: On-disk archive file path
+     * :return: None
+     */
+    statsPhase(STATS_WRITE);
+    dequeCompact(deque);
+    int fd = openFileReadWrite(pathname);
+    struct stat filedata;
+    fstat(fd, &filedata);
 
-        // Write ar_size to archive
-        bytesWritten = write(fd, cur->data->header->ar_size, AR_SIZE_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_size to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
+    off_t collapsed = 0; // bytes already removed by collapsing ranges
+    off_t writeOffset = SARMAG;
+    if(deque->catalog != NULL){
+        writeOffset = deque->catalog->offset+deque->catalog->length;
+    }
+    for(size_t i=0; i < deque->count; i++){
+        archivedFileStruct *archivedFile = &deque->members[i];
+        off_t readOffset = archivedFile->offset-collapsed;
+        off_t gap = readOffset-writeOffset;
+        if(gap > 0 && writeOffset%filedata.st_blksize == 0 && gap%filedata.st_blksize == 0 &&
+                fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, writeOffset, gap) == 0){ // Block aligned gap
+            collapsed += gap;
+            filedata.st_size -= gap;
+        }else if(gap > 0){
+            fileMoveRange(fd, readOffset, writeOffset, archivedFile->length, pathname);
         }
+        archivedFile->offset = writeOffset;
+        writeOffset += archivedFile->length;
+    }
 
-        // Write ar_fmag to archive
-        bytesWritten = write(fd, cur->data->header->ar_fmag, AR_FMAG_SIZE);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write ar_fmag to file \"%s\"\n", pathname);
+    if(writeOffset < filedata.st_size && ftruncate(fd, writeOffset) == -1){
+        fprintf(stderr, "Error: Cannot truncate file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+
+    // Rewrite catalog in place at its current size
+    if(deque->catalog != NULL){
+        archivedFileStruct *catalog = deque->catalog;
+        size_t bodySize = catalog->size;
+        char *body = dequeStructToCatalogBody(deque, bodySize, writeOffset);
+        off_t bodyOffset = catalog->offset+sizeof(archivedFileHeaderStruct);
+        if(pwrite(fd, body, bodySize, bodyOffset) != (ssize_t)bodySize){
+            fprintf(stderr, "Error: Cannot write catalog to file \"%s\"\n", pathname);
             exit(EXIT_FAILURE);
         }
+    }
+    close(fd);
+}
 
-        // Write archived file data to archive
-        int ar_size;
-        sscanf(cur->data->header->ar_size, "%d", &ar_size);
-        bytesWritten = write(fd, cur->data->body, ar_size);
-        if(bytesWritten == -1){
-            fprintf(stderr, "Error: Cannot write body to file \"%s\"\n", pathname);
-            exit(EXIT_FAILURE);
+char *dequeStructToCatalogBody(dequeStruct *deque, size_t bodySize, off_t endOffset){
+    /**
+     * Build catalog member body from deque archived file offsets
+     * :param deque: Archived structured data deque without tombstones
+     * :param bodySize: Catalog member body size
+     * :param endOffset: Archive file offset after the last archived file
+     * :return: Catalog member body from the deque arena, covering as many archived files as fit
+     */
+    char *body = arenaAlloc(deque->arena, bodySize);
+    size_t capacity = catalogCapacity(bodySize);
+    size_t count = 0;
+    for(; count < deque->count; count++){
+        archivedFileStruct *archivedFile = &deque->members[count];
+        if(count == capacity){ // Readers scan the uncovered archived files
+            endOffset = archivedFile->offset;
+            break;
         }
+        catalogWriteRecord(body, count, archivedFile->offset, archivedFile->header, archivedFile->isHashed, archivedFile->hash);
+    }
+    catalogWritePreamble(body, bodySize, count, endOffset);
+    return body;
+}
 
-        cur = cur->next;
+void dequeStructRefreshCatalog(dequeStruct *deque){
+    /**
+     * Rebuild catalog member for writing the deque to a new archive
+     * Archived file offsets are set to where `dequeStructToArchive` writes them
+     * :param deque: Archived structured data deque
+     * :return: None
+     */
+    dequeCompact(deque);
+    size_t bodySize = catalogBodySize(deque->count);
+
+    // Assign archived file offsets
+    off_t offset = SARMAG+sizeof(archivedFileHeaderStruct)+bodySize;
+    for(size_t i=0; i < deque->count; i++){
+        archivedFileStruct *archivedFile = &deque->members[i];
+        archivedFile->offset = offset;
+        archivedFile->length = sizeof(archivedFileHeaderStruct)+archivedFile->size+archivedFile->size%2;
+        offset += archivedFile->length;
     }
 
-    close(fd);
+    // Replace catalog member
+    archivedFileHeaderStruct *header = arenaAlloc(deque->arena, sizeof(archivedFileHeaderStruct));
+    catalogHeader(header, bodySize);
+    archivedFileStruct *catalog = arenaAlloc(deque->arena, sizeof(archivedFileStruct));
+    archivedFileParseHeader(catalog, header, SARMAG);
+    catalog->body = dequeStructToCatalogBody(deque, bodySize, offset);
+    catalog->length = sizeof(archivedFileHeaderStruct)+bodySize;
+    deque->catalog = catalog;
+}
+
+void archivedFileStructToArchive(archivedFileStruct *archivedFile, writerStruct *writer){
+    /**
+     * Queue archived file header and body on archive gathered writer
+     * The archived file must stay allocated until the writer is flushed,
+     * and a streamed body is copied through the writer right away
+     * :param archivedFile: Archived file structured data
+     * :param writer: On-disk archive file gathered writer
+     * :return: None
+     */
+    writerWrite(writer, archivedFile->header, sizeof(archivedFileHeaderStruct));
+    if(archivedFile->body != NULL){
+        writerWrite(writer, archivedFile->body, archivedFile->size);
+    }else if(writerCopy(writer, archivedFile->fd, 0, archivedFile->size) != archivedFile->size){ // Stream body
+        fprintf(stderr, "Error: Cannot read from file \"%s\"\n", archivedFile->name);
+        exit(EXIT_FAILURE);
+    }
+
+    // Write standard even padding to archive
+    if(archivedFile->size%2 == 1){
+        writerWrite(writer, "\n", 1);
+    }
 }
 
-void archivedFileStructToFile(archivedFileStruct *archivedFile){
+void archivedFileStructToFile(dequeStruct *deque, archivedFileStruct *archivedFile){
+    /**
+     * Write archived file to on-disk file and restore its metadata
+     * A body left on-disk is streamed from the archive in bounded memory
+     * A body compressed by -z is decompressed and checked against its hash
+     * Metadata is restored through the open file descriptor
+     * :param deque: Deque data structure owning the archived file
+     * :param archivedFile: Archived file structured data
+     * :return: None
+     */
     // Write file body
-    char *ar_name = archivedFile->header->ar_name;
+    char *ar_name = archivedFile->name;
     int fd = openFileWriteOnlyCreateTruncate(ar_name);
-    int ar_size;
-    sscanf(archivedFile->header->ar_size, "%d", &ar_size);
-    int bytesWritten = write(fd, archivedFile->body, ar_size);
-    if(bytesWritten != ar_size){
-        fprintf(stderr, "Error: Cannot write body to file \"%s\"\n", ar_name);
-        exit(EXIT_FAILURE);
+    writerStruct *writer = writerOpen(fd, ar_name);
+    uint64_t size, hash;
+    if(archivedFile->body == NULL && archivedFile->fd < 0){
+        dequeCheckHeader(deque, archivedFile, archivedFile->offset);
+    }
+    if(archivedFile->isCompressed){ // Compressed by -z
+        if(!archivedFileFrame(deque, archivedFile, &size, &hash)){ // Error handling
+            fprintf(stderr, "Error: Corrupt compressed archived file \"%s\"\n", archivedFile->name);
+            exit(EXIT_FAILURE);
+        }
+        archivedFileDecompress(deque, archivedFile, writer, size, hash);
+    }else if(archivedFile->body != NULL){
+        writerWrite(writer, archivedFile->body, archivedFile->size);
+    }else if(archivedFile->fd >= 0){ // Streamed unarchived file
+        if(writerCopy(writer, archivedFile->fd, 0, archivedFile->size) != archivedFile->size){
+            fprintf(stderr, "Error: Cannot read from file \"%s\"\n", archivedFile->name);
+            exit(EXIT_FAILURE);
+        }
+    }else{
+        off_t bodyOffset = archivedFile->offset+sizeof(archivedFileHeaderStruct);
+        if(writerCopy(writer, deque->fd, bodyOffset, archivedFile->size) != archivedFile->size){
+            fprintf(stderr, "Error: Cannot read body from archive\n");
+            exit(EXIT_FAILURE);
+        }
     }
+    writerClose(writer);
 
     // Change file permissions
-    int ar_mode;
-    sscanf(archivedFile->header->ar_mode, "%d", &ar_mode);
-    int mod = chmod(ar_name, ar_mode);
-    if(mod == -1){
+    if(fchmod(fd, archivedFile->mode) == -1){
         fprintf(stderr, "Error: Cannot change permissions on file \"%s\"\n", ar_name);
         exit(EXIT_FAILURE);
     }
 
     // Change file ownership
-    int ar_uid;
-    int ar_gid;
-    sscanf(archivedFile->header->ar_uid, "%d", &ar_uid);
-    sscanf(archivedFile->header->ar_gid, "%d", &ar_gid);
-    int own = chown(ar_name, ar_uid, ar_gid);
-    if(own == -1){
+    if(fchown(fd, archivedFile->uid, archivedFile->gid) == -1){
         fprintf(stderr, "Error: Cannot change ownership on file \"%s\"\n", ar_name);
         exit(EXIT_FAILURE);
     }
 
     // Change file timestamp
-    int date;
-    sscanf(archivedFile->header->ar_date, "%d", &date);
-    struct utimbuf *datebuffer = malloc(sizeof(struct utimbuf));
-    datebuffer->actime = date;
-    datebuffer->modtime = date;
-    if(utime(ar_name, datebuffer) == -1){
+    struct timespec times[2] = {{.tv_sec = archivedFile->date}, {.tv_sec = archivedFile->date}};
+    if(futimens(fd, times) == -1){
         fprintf(stderr, "Error: Cannot change timestamp on file \"%s\"\n", ar_name);
         exit(EXIT_FAILURE);
     }
-    free(datebuffer);
+    close(fd);
 }
 
 void archivedFileStructPrintVerbose(archivedFileStruct *archivedFile){
+    /**
+     * Print archived file line of verbose table from its header alone
+     * A body compressed by -z is listed at its archived size, like GNU ar
+     * :param archivedFile: Archived file structured data
+     * :return: None
+     */
     // Print file permissions
-    int ar_mode;
-    sscanf(archivedFile->header->ar_mode, "%d", &ar_mode);
+    int ar_mode = archivedFile->mode;
     // **Readable ar_mode conversion print like StackOverflow solution**
     printf((ar_mode & S_IRUSR) ? "r" : "-");
     printf((ar_mode & S_IWUSR) ? "w" : "-");
@@ -454,24 +939,23 @@ void archivedFileStructPrintVerbose(archivedFileStruct *archivedFile){
     printf(" ");
 
     // Print file owners
-    printf("%s/%s\t", archivedFile->header->ar_uid, archivedFile->header->ar_gid);
+    printf("%d/%d\t", archivedFile->uid, archivedFile->gid);
 
     // Print file size
-    printf("%s ", archivedFile->header->ar_size);
+    printf("%lld ", (long long)archivedFile->size);
 
     // Print readable file last modified time
-    long int ar_date;
-    sscanf(archivedFile->header->ar_date, "%ld", &ar_date);
+    long int ar_date = archivedFile->date;
     struct tm date;
     memcpy(&date, localtime(&ar_date), sizeof(struct tm));
     printf("%s %d %02d:%02d %d ", monthName(date.tm_mon), date.tm_mday, date.tm_hour, date.tm_min, date.tm_year+1900);
 
     // Print file name
-    printf("%s\n", archivedFile->header->ar_name);
+    printf("%s\n", archivedFile->name);
 }
 
 char *monthName(int month){
-    char *monthName;
+    char *monthName = "???";
     switch(month){
         case 0:
             monthName = "Jan";
@@ -515,50 +999,246 @@ char *monthName(int month){
     return monthName;
 }
 
-void dequeStructAppendArchivedFile(dequeStruct *deque, char *pathname){
+void archivedFileName(archivedFileStruct *archivedFile, char *name){
     /**
-     * Deque append on-disk unarchived file
-     * :param deque: Archive structured data deque
-     * :param pathname: On-disk unarchived file path
+     * Archived file name without NUL, space or GNU slash terminators
+     * :param archivedFile: Archived file structured data
+     * :param name: Destination of at least AR_NAME_SIZE+1 characters
      * :return: None
      */
+    headerParseName(archivedFile->header, name);
+}
+
+archivedFileStruct *fileToArchivedFileStruct(char *pathname, int isCompressed){
+    /**
+     * Read on-disk unarchived file to archived file structured data
+     * :param pathname: On-disk unarchived file path
+     * :param isCompressed: Compress the body, see `archivedFileCompress`
+     * :return: Archived file structured data
+     */
     char *filename = basename(pathname);
     if(strlen(filename) >= AR_NAME_SIZE){ // Error handling
         fprintf(stderr, "Error: Pathname \"%s\" character limit \"%d\"\n", pathname, AR_NAME_SIZE);
         exit(EXIT_FAILURE);
     }
 
-    // Create archived file header
-    archivedFileHeaderStruct *archivedFileHeader = malloc(sizeof(archivedFileHeaderStruct));
-    // Fill archived file header
+    // Create archived file
     struct stat filedata;
     int fd = openFileReadOnly(pathname);
     fstat(fd, &filedata);
-    sprintf(archivedFileHeader->ar_name, "%s", filename);
-    sprintf(archivedFileHeader->ar_date, "%ld", filedata.st_mtime);
-    sprintf(archivedFileHeader->ar_uid, "%d", filedata.st_uid);
-    sprintf(archivedFileHeader->ar_gid, "%d", filedata.st_gid);
-    sprintf(archivedFileHeader->ar_mode, "%d", filedata.st_mode);
-    sprintf(archivedFileHeader->ar_size, "%ld", filedata.st_size);
-    sprintf(archivedFileHeader->ar_fmag, "%s", ARFMAG);
+    archivedFileStruct *archivedFile = statToArchivedFileStruct(pathname, &filedata);
+    if(filedata.st_size > DEQUE_STREAM_THRESHOLD){ // Body is streamed by the archive writer
+        archivedFile->fd = fd;
+    }else{
+        archivedFile->body = malloc(filedata.st_size > 0 ? filedata.st_size : 1);
+        ssize_t bytesRead = read(fd, archivedFile->body, filedata.st_size);
+        if(bytesRead != filedata.st_size){
+            fprintf(stderr, "Error: Cannot read from file \"%s\"\n", pathname);
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+
+    if(isCompressed){
+        archivedFileCompress(archivedFile);
+    }
+    return archivedFile;
+}
+
+archivedFileStruct *statToArchivedFileStruct(char *pathname, struct stat *filedata){
+    /**
+     * Archived file structured data for on-disk unarchived file metadata
+     * The body is left for the caller to read
+     * :param pathname: On-disk unarchived file path, name within AR_NAME_SIZE
+     * :param filedata: On-disk unarchived file metadata
+     * :return: Archived file structured data with NULL body
+     */
+    if(filedata->st_size > AR_SIZE_MAX){ // Error handling
+        fprintf(stderr, "Error: File \"%s\" exceeds the %lld byte archived file limit\n", pathname, AR_SIZE_MAX);
+        exit(EXIT_FAILURE);
+    }
+
+    // Create archived file header
+    archivedFileHeaderStruct *archivedFileHeader = malloc(sizeof(archivedFileHeaderStruct));
+    // Fill archived file header
+    headerFormatName(archivedFileHeader, basename(pathname));
+    if(!headerFormatField(archivedFileHeader->ar_date, AR_DATE_SIZE, HEADER_DECIMAL, filedata->st_mtime) ||
+            !headerFormatField(archivedFileHeader->ar_uid, AR_UID_SIZE, HEADER_DECIMAL, filedata->st_uid) ||
+            !headerFormatField(archivedFileHeader->ar_gid, AR_GID_SIZE, HEADER_DECIMAL, filedata->st_gid) ||
+            !headerFormatField(archivedFileHeader->ar_mode, AR_MODE_SIZE, HEADER_OCTAL, filedata->st_mode) ||
+            !headerFormatField(archivedFileHeader->ar_size, AR_SIZE_SIZE, HEADER_DECIMAL, filedata->st_size)){ // Error handling
+        fprintf(stderr, "Error: File \"%s\" metadata does not fit archive header\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(archivedFileHeader->ar_fmag, ARFMAG, AR_FMAG_SIZE);
 
     // Create archived file
     archivedFileStruct *archivedFile = malloc(sizeof(archivedFileStruct));
     // Fill archived file
-    archivedFile->header = archivedFileHeader;
-    lseek(fd, 0, SEEK_SET);
-    char *buffer = malloc(filedata.st_size);
-    int bytesRead = read(fd, buffer, filedata.st_size);
-    if(bytesRead != filedata.st_size){
-        fprintf(stderr, "Error: Cannot read from file \"%s\"\n", pathname);
+    archivedFileParseHeader(archivedFile, archivedFileHeader, -1);
+    archivedFile->length = 0;
+    return archivedFile;
+}
+
+void archivedFileCompress(archivedFileStruct *archivedFile){
+    /**
+     * Replace unarchived file body with its compressed form, see lz.h
+     * The body is kept as is unless compression makes it smaller
+     * A streamed body is compressed into an unnamed temporary file, and
+     * left as is at once if its first block does not shrink
+     * :param archivedFile: Unarchived file structured data
+     * :return: None
+     */
+    off_t size = archivedFile->size;
+    if(size <= LZ_FRAME_SIZE){
+        return;
+    }
+    off_t length;
+
+    if(archivedFile->body != NULL){ // Compress in memory
+        unsigned char *body = malloc(LZ_BODY_CAPACITY(size));
+        length = lzCompressBody((unsigned char *)archivedFile->body, size, hashBytes(archivedFile->body, size), body);
+        if(length == 0){
+            free(body);
+            return;
+        }
+        free(archivedFile->body);
+        archivedFile->body = (char *)body;
+    }else{ // Compress streamed body one block at a time
+        int fd = lzCompressFile(archivedFile->fd, size, &length);
+        if(length == -1){ // Error handling
+            fprintf(stderr, "Error: Cannot read from file \"%s\"\n", archivedFile->name);
+            exit(EXIT_FAILURE);
+        }
+        if(fd == -1){
+            return;
+        }
+        close(archivedFile->fd);
+        archivedFile->fd = fd;
+    }
+
+    // Header records the compressed size and marks the mode
+    archivedFile->size = length;
+    archivedFile->isHashed = 0;
+    archivedFile->isCompressed = 1;
+    headerFormatField(archivedFile->header->ar_size, AR_SIZE_SIZE, HEADER_DECIMAL, length);
+    headerFormatField(archivedFile->header->ar_mode, AR_MODE_SIZE, HEADER_OCTAL, archivedFile->mode | AR_MODE_COMPRESSED);
+}
+
+int archivedFileFrame(dequeStruct *deque, archivedFileStruct *archivedFile, uint64_t *size, uint64_t *hash){
+    /**
+     * Read compressed body frame of archived file
+     * Only archived files marked compressed in their header are read
+     * :param deque: Deque data structure owning the archived file
+     * :param archivedFile: Archived file structured data
+     * :param size: Destination of uncompressed bytes
+     * :param hash: Destination of uncompressed content hash
+     * :return: Body was compressed by -z and its frame is valid
+     */
+    unsigned char frame[LZ_FRAME_SIZE];
+    if(!archivedFile->isCompressed || archivedFile->size < LZ_FRAME_SIZE || !archivedFileReadBody(deque, archivedFile, 0, frame, LZ_FRAME_SIZE)){
+        return 0;
+    }
+    return lzReadFrame(frame, LZ_FRAME_SIZE, size, hash);
+}
+
+void archivedFileDecompress(dequeStruct *deque, archivedFileStruct *archivedFile, writerStruct *writer, uint64_t size, uint64_t hash){
+    /**
+     * Write compressed archived file body decompressed
+     * Blocks are read ahead in bounded memory, about one pread per block
+     * :param deque: Deque data structure owning the archived file
+     * :param archivedFile: Archived file structured data
+     * :param writer: Destination writer
+     * :param size: Uncompressed bytes from the frame
+     * :param hash: Uncompressed content hash from the frame
+     * :return: None
+     */
+    unsigned char *input = malloc(DEQUE_INPUT_SIZE);
+    unsigned char *output = malloc(LZ_BLOCK_SIZE);
+    size_t start = 0, end = 0; // unread input
+    off_t offset = LZ_FRAME_SIZE; // body offset following the input
+    uint64_t written = 0;
+    hashStateStruct state;
+    hashInit(&state);
+    int isCorrupt = 0;
+    while(end > start || offset < archivedFile->size){
+        // Read ahead so the next block header and block are whole
+        size_t need = LZ_BLOCK_HEADER_SIZE;
+        if(end-start >= LZ_BLOCK_HEADER_SIZE){
+            need += lzRead32(input+start) & ~LZ_STORED;
+        }
+        if(end-start < need){
+            if(need > DEQUE_INPUT_SIZE || offset == archivedFile->size){ // Error handling
+                isCorrupt = 1;
+                break;
+            }
+            memmove(input, input+start, end-start);
+            end -= start;
+            start = 0;
+            size_t count = DEQUE_INPUT_SIZE-end;
+            if(count > (uint64_t)(archivedFile->size-offset)){
+                count = archivedFile->size-offset;
+            }
+            if(!archivedFileReadBody(deque, archivedFile, offset, input+end, count)){
+                fprintf(stderr, "Error: Cannot read body from archive\n");
+                exit(EXIT_FAILURE);
+            }
+            end += count;
+            offset += count;
+            continue;
+        }
+
+        // Decompress block
+        uint32_t word = lzRead32(input+start);
+        size_t count = word & ~LZ_STORED;
+        if(count > LZ_BLOCK_SIZE){ // Error handling
+            isCorrupt = 1;
+            break;
+        }
+        unsigned char *block = input+start+LZ_BLOCK_HEADER_SIZE;
+        long length = count;
+        if(!(word & LZ_STORED)){
+            length = lzDecompressBlock(block, count, output, LZ_BLOCK_SIZE);
+            block = output;
+        }
+        if(length < 0 || written+length > size){ // Error handling
+            isCorrupt = 1;
+            break;
+        }
+        hashUpdate(&state, block, length);
+        writerWrite(writer, block, length);
+        writerFlush(writer); // input and output are reused by the next block
+        written += length;
+        start += need;
+    }
+    free(input);
+    free(output);
+    if(isCorrupt || written != size || hashDigest(&state) != hash){ // Error handling
+        fprintf(stderr, "Error: Corrupt compressed archived file \"%s\"\n", archivedFile->name);
         exit(EXIT_FAILURE);
     }
-    archivedFile->body = malloc(filedata.st_size*sizeof(char));
-    memcpy(archivedFile->body, buffer, filedata.st_size);
-    free(buffer);
+}
 
-    dequeAppendRear(deque, archivedFile);
-    close(fd);
+int archivedFileReadBody(dequeStruct *deque, archivedFileStruct *archivedFile, off_t offset, void *buffer, size_t count){
+    /**
+     * Read range of archived file body from memory, the streamed file or the archive
+     * :param deque: Deque data structure owning the archived file
+     * :param archivedFile: Archived file structured data
+     * :param offset: Body offset
+     * :param buffer: Destination
+     * :param count: Bytes to read, within the body
+     * :return: Range was read whole
+     */
+    if(archivedFile->body != NULL){
+        memcpy(buffer, archivedFile->body+offset, count);
+        return 1;
+    }
+    int fd = archivedFile->fd;
+    if(fd < 0){
+        fd = deque->fd;
+        offset += archivedFile->offset+sizeof(archivedFileHeaderStruct);
+    }
+    return fd >= 0 && pread(fd, buffer, count, offset) == (ssize_t)count;
 }
 
 void dequeStructDeleteArchivedFile(dequeStruct *deque, char *pathname){
@@ -568,16 +1248,84 @@ void dequeStructDeleteArchivedFile(dequeStruct *deque, char *pathname){
      * :param pathname: On-disk archived file path
      * :return: None
      */
-    dequeNodeStruct *cur = deque->front;
-    while(cur != NULL){
-        if(cur->data != NULL){
-            if(strncmp(cur->data->header->ar_name, pathname, strlen(pathname)) == 0){
-                cur->prev->next = cur->next;
-                cur->next->prev = cur->prev;
-                dequeNodeFree(cur);
-                break;
+    nameIndexEntryStruct *entry = nameIndexFind(deque->index, pathname);
+    if(entry != NULL){ // Tombstone until `dequeCompact`
+        size_t position = entry->position;
+        deque->members[position].isDeleted = 1;
+        deque->deletedCount++;
+        nameIndexRemove(deque->index, pathname, position);
+    }
+}
+
+int dequeStructHasArchivedFile(dequeStruct *deque, archivedFileStruct *archivedFile){
+    /**
+     * Deque holds an archived file of the same name and content
+     * Sizes are compared first, content hashes only on equal sizes
+     * :param deque: Archive structured data deque with open archive
+     * :param archivedFile: Archived file structured data
+     * :return: Has identical archived file
+     */
+    nameIndexEntryStruct *entry = nameIndexFind(deque->index, archivedFile->name);
+    while(entry != NULL){
+        archivedFileStruct *other = &deque->members[entry->position];
+        if(other->size == archivedFile->size &&
+                archivedFileHash(deque, other) == archivedFileHash(deque, archivedFile)){
+            return 1;
+        }
+        entry = nameIndexFindNext(entry);
+    }
+    return 0;
+}
+
+int dequeStructHasUnchangedFile(dequeStruct *deque, char *name, struct stat *filedata){
+    /**
+     * Deque holds an archived file of the same name, size and modification time
+     * The size of a compressed archived file is read from its frame
+     * :param deque: Archive structured data deque with open archive
+     * :param name: Archived file name
+     * :param filedata: On-disk unarchived file metadata
+     * :return: Has unchanged archived file
+     */
+    nameIndexEntryStruct *entry = nameIndexFind(deque->index, name);
+    uint64_t size, hash;
+    while(entry != NULL){
+        archivedFileStruct *other = &deque->members[entry->position];
+        if(other->date == filedata->st_mtime && (other->size == filedata->st_size ||
+                (archivedFileFrame(deque, other, &size, &hash) && size == (uint64_t)filedata->st_size))){
+            return 1;
+        }
+        entry = nameIndexFindNext(entry);
+    }
+    return 0;
+}
+
+uint64_t archivedFileHash(dequeStruct *deque, archivedFileStruct *archivedFile){
+    /**
+     * Content hash of archived file body, computed once and cached
+     * A body left on-disk is hashed one block at a time. The cache outlives
+     * the run only through the catalog member, since the archived file
+     * header has no field for it, so without a catalog every run rehashes
+     * :param deque: Archive structured data deque with open archive
+     * :param archivedFile: Archived file structured data
+     * :return: Content hash
+     */
+    if(!archivedFile->isHashed){
+        if(archivedFile->body != NULL){
+            archivedFile->hash = hashBytes(archivedFile->body, archivedFile->size);
+        }else if(archivedFile->fd >= 0){ // Streamed unarchived file
+            if(!hashFile(archivedFile->fd, 0, archivedFile->size, &archivedFile->hash)){
+                fprintf(stderr, "Error: Cannot read from file \"%s\"\n", archivedFile->name);
+                exit(EXIT_FAILURE);
+            }
+        }else{
+            dequeCheckHeader(deque, archivedFile, archivedFile->offset);
+            off_t bodyOffset = archivedFile->offset+sizeof(archivedFileHeaderStruct);
+            if(!hashFile(deque->fd, bodyOffset, archivedFile->size, &archivedFile->hash)){
+                fprintf(stderr, "Error: Cannot read body from archive\n");
+                exit(EXIT_FAILURE);
             }
         }
-        cur = cur->next;
+        archivedFile->isHashed = 1;
     }
+    return archivedFile->hash;
 }
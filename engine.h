@@ -0,0 +1,346 @@
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "uring.h"
+
+
+#define ENGINE_BLOCKING 0
+#define ENGINE_URING 1
+#define ENGINE_BATCH 64 // files per ring submission
+#define ENGINE_RING_ENTRIES 256 // room for ENGINE_BATCH chains of 3 entries
+#define ENGINE_BODY_LIMIT (1 << 16) // larger files take the blocking path
+#define ENGINE_INFLATE_LIMIT (1 << 20) // compressed bodies inflating past this take the blocking path
+#define ENGINE_STEPS 3 // chain entries per file, see `engineData`
+#define ENGINE_OPEN 0
+#define ENGINE_TRANSFER 1
+#define ENGINE_CLOSE 2
+
+
+/* Bulk file I/O backend for -x and the serial -q/-A append. The blocking
+   engine makes one system call per operation, as myar always has. The
+   io_uring engine batches small files: per file one chain opens the file
+   into a direct descriptor slot, reads or writes its whole body and closes
+   it, linked so each step waits for the last, and a batch of chains goes to
+   the kernel with one io_uring_enter. io_uring has no chmod, chown or utime
+   operation, so extracted file metadata is still restored by path. Large
+   files, and everything when no ring can be set up, take the blocking
+   path. */
+
+typedef struct engine{
+    int kind; // ENGINE_BLOCKING, or ENGINE_URING once a ring is set up
+    uringStruct *ring;
+    size_t batch; // files to hand `engineIngest` at once
+    char *buffer; // ENGINE_BATCH extraction slots of header and body
+}engineStruct;
+
+
+engineStruct *engineOpen(int kind);
+void engineClose(engineStruct *engine);
+void engineExtract(engineStruct *engine, dequeStruct *deque, archivedFileStruct **archivedFiles, size_t count);
+void engineExtractBatch(engineStruct *engine, dequeStruct *deque, archivedFileStruct **archivedFiles, size_t count);
+void engineIngest(engineStruct *engine, char **pathnames, size_t count, int isCompressed, archivedFileStruct **archivedFiles);
+void engineSubmit(engineStruct *engine, int *results);
+uint64_t engineData(size_t i, int step);
+
+
+engineStruct *engineOpen(int kind){
+    /**
+     * Open I/O engine, falling back to blocking when io_uring is unavailable
+     * :param kind: ENGINE_BLOCKING or ENGINE_URING
+     * :return: I/O engine
+     */
+    engineStruct *engine = malloc(sizeof(engineStruct));
+    engine->kind = ENGINE_BLOCKING;
+    engine->ring = NULL;
+    engine->batch = 1;
+    engine->buffer = NULL;
+    if(kind == ENGINE_URING){
+        engine->ring = uringOpen(ENGINE_RING_ENTRIES, ENGINE_BATCH);
+    }
+    if(engine->ring != NULL){
+        engine->kind = ENGINE_URING;
+        engine->batch = ENGINE_BATCH;
+        engine->buffer = malloc(ENGINE_BATCH*(sizeof(archivedFileHeaderStruct)+ENGINE_BODY_LIMIT));
+    }
+    return engine;
+}
+
+void engineClose(engineStruct *engine){
+    /**
+     * Close I/O engine and free its heap memory
+     * :param engine: I/O engine
+     * :return: None
+     */
+    if(engine->ring != NULL){
+        uringClose(engine->ring);
+    }
+    free(engine->buffer);
+    free(engine);
+}
+
+void engineExtract(engineStruct *engine, dequeStruct *deque, archivedFileStruct **archivedFiles, size_t count){
+    /**
+     * Write archived files to on-disk files and restore their metadata
+     * :param engine: I/O engine
+     * :param deque: Deque data structure owning the archived files, with open archive
+     * :param archivedFiles: Archived files, distinct names
+     * :param count: Archived files count
+     * :return: None
+     */
+    archivedFileStruct *batch[ENGINE_BATCH];
+    size_t batchCount = 0;
+    for(size_t i=0; i < count; i++){
+        archivedFileStruct *archivedFile = archivedFiles[i];
+        if(engine->ring == NULL || archivedFile->body != NULL || archivedFile->fd >= 0 || deque->fd < 0 || archivedFile->size > ENGINE_BODY_LIMIT){
+            archivedFileStructToFile(deque, archivedFile);
+            continue;
+        }
+        batch[batchCount++] = archivedFile;
+        if(batchCount == ENGINE_BATCH){
+            engineExtractBatch(engine, deque, batch, batchCount);
+            batchCount = 0;
+        }
+    }
+    if(batchCount > 0){
+        engineExtractBatch(engine, deque, batch, batchCount);
+    }
+}
+
+void engineExtractBatch(engineStruct *engine, dequeStruct *deque, archivedFileStruct **archivedFiles, size_t count){
+    /**
+     * Extract batch of small archived files through the ring
+     * Headers and bodies are read in one submission, checked and inflated,
+     * then each file is opened, written and closed by one linked chain
+     * :param engine: I/O engine with ring
+     * :param deque: Deque data structure owning the archived files, with open archive
+     * :param archivedFiles: Archived files with bodies on-disk, at most ENGINE_BATCH
+     * :param count: Archived files count
+     * :return: None
+     */
+    uringStruct *ring = engine->ring;
+    int results[ENGINE_BATCH*ENGINE_STEPS];
+    char *bodies[ENGINE_BATCH];
+    char *inflated[ENGINE_BATCH];
+    size_t sizes[ENGINE_BATCH];
+    bool isBlocking[ENGINE_BATCH];
+
+    // Read headers and bodies
+    for(size_t i=0; i < count; i++){
+        archivedFileStruct *archivedFile = archivedFiles[i];
+        char *slot = engine->buffer+i*(sizeof(archivedFileHeaderStruct)+ENGINE_BODY_LIMIT);
+        uringPrepare(ring, IORING_OP_READ, deque->fd, slot, sizeof(archivedFileHeaderStruct)+archivedFile->size,
+                archivedFile->offset, engineData(i, ENGINE_TRANSFER));
+    }
+    engineSubmit(engine, results);
+
+    // Check headers like `dequeCheckHeader`, inflate bodies compressed by -z
+    for(size_t i=0; i < count; i++){
+        archivedFileStruct *archivedFile = archivedFiles[i];
+        char *slot = engine->buffer+i*(sizeof(archivedFileHeaderStruct)+ENGINE_BODY_LIMIT);
+        if(results[engineData(i, ENGINE_TRANSFER)] != (int)(sizeof(archivedFileHeaderStruct)+archivedFile->size)){
+            fprintf(stderr, "Error: Cannot read body from archive\n");
+            exit(EXIT_FAILURE);
+        }
+        if(memcmp(slot, archivedFile->header, sizeof(archivedFileHeaderStruct)) != 0){
+            fprintf(stderr, "Error: Stale catalog in archive, rebuild it with -s\n");
+            exit(EXIT_FAILURE);
+        }
+        bodies[i] = slot+sizeof(archivedFileHeaderStruct);
+        sizes[i] = archivedFile->size;
+        inflated[i] = NULL;
+        isBlocking[i] = false;
+        uint64_t size, hash;
+        if(!archivedFile->isCompressed){
+            continue;
+        }
+        if(!lzReadFrame((unsigned char *)bodies[i], sizes[i], &size, &hash)){ // Error handling
+            fprintf(stderr, "Error: Corrupt compressed archived file \"%s\"\n", archivedFile->name);
+            exit(EXIT_FAILURE);
+        }
+        if(size > ENGINE_INFLATE_LIMIT){
+            isBlocking[i] = true;
+            continue;
+        }
+        inflated[i] = malloc(size > 0 ? size : 1);
+        if(lzDecompressFrame((unsigned char *)bodies[i], sizes[i], (unsigned char *)inflated[i], size) != (long)size ||
+                hashBytes(inflated[i], size) != hash){ // Error handling
+            fprintf(stderr, "Error: Corrupt compressed archived file \"%s\"\n", archivedFile->name);
+            exit(EXIT_FAILURE);
+        }
+        bodies[i] = inflated[i];
+        sizes[i] = size;
+    }
+
+    // Open, write and close each file in one linked chain
+    for(size_t i=0; i < count; i++){
+        if(isBlocking[i]){
+            continue;
+        }
+        struct io_uring_sqe *sqe = uringPrepare(ring, IORING_OP_OPENAT, AT_FDCWD, archivedFiles[i]->name, 0666, 0, engineData(i, ENGINE_OPEN));
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+        sqe->file_index = i+1;
+        sqe->flags = IOSQE_IO_LINK;
+        if(sizes[i] > 0){
+            sqe = uringPrepare(ring, IORING_OP_WRITE, i, bodies[i], sizes[i], 0, engineData(i, ENGINE_TRANSFER));
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+        }
+        sqe = uringPrepare(ring, IORING_OP_CLOSE, 0, NULL, 0, 0, engineData(i, ENGINE_CLOSE));
+        sqe->file_index = i+1;
+    }
+    engineSubmit(engine, results);
+
+    // Restore metadata by path, as `archivedFileStructToFile` does through the file descriptor
+    for(size_t i=0; i < count; i++){
+        archivedFileStruct *archivedFile = archivedFiles[i];
+        char *ar_name = archivedFile->name;
+        if(isBlocking[i]){
+            archivedFileStructToFile(deque, archivedFile);
+            continue;
+        }
+        free(inflated[i]);
+        if(results[engineData(i, ENGINE_OPEN)] < 0){
+            fprintf(stderr, "Error: Cannot write only create truncate open file \"%s\"\n", ar_name);
+            exit(EXIT_FAILURE);
+        }
+        if(sizes[i] > 0 && results[engineData(i, ENGINE_TRANSFER)] != (int)sizes[i]){
+            fprintf(stderr, "Error: Cannot write to file \"%s\"\n", ar_name);
+            exit(EXIT_FAILURE);
+        }
+
+        // Change file permissions
+        if(chmod(ar_name, archivedFile->mode) == -1){
+            fprintf(stderr, "Error: Cannot change permissions on file \"%s\"\n", ar_name);
+            exit(EXIT_FAILURE);
+        }
+
+        // Change file ownership
+        if(chown(ar_name, archivedFile->uid, archivedFile->gid) == -1){
+            fprintf(stderr, "Error: Cannot change ownership on file \"%s\"\n", ar_name);
+            exit(EXIT_FAILURE);
+        }
+
+        // Change file timestamp
+        struct timespec times[2] = {{.tv_sec = archivedFile->date}, {.tv_sec = archivedFile->date}};
+        if(utimensat(AT_FDCWD, ar_name, times, 0) == -1){
+            fprintf(stderr, "Error: Cannot change timestamp on file \"%s\"\n", ar_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void engineIngest(engineStruct *engine, char **pathnames, size_t count, int isCompressed, archivedFileStruct **archivedFiles){
+    /**
+     * Read on-disk unarchived files to archived file structured data
+     * Through the ring, files are stat'ed in one submission, then each small
+     * file is opened, read and closed by one linked chain
+     * :param engine: I/O engine
+     * :param pathnames: On-disk unarchived file paths, at most engine->batch
+     * :param count: On-disk unarchived file paths count
+     * :param isCompressed: Compress the bodies, see `archivedFileCompress`
+     * :param archivedFiles: Destination of archived files in pathname order
+     * :return: None
+     */
+    if(engine->ring == NULL){
+        for(size_t i=0; i < count; i++){
+            archivedFiles[i] = fileToArchivedFileStruct(pathnames[i], isCompressed);
+        }
+        return;
+    }
+    uringStruct *ring = engine->ring;
+    int results[ENGINE_BATCH*ENGINE_STEPS];
+    struct statx files[ENGINE_BATCH];
+    char *bodies[ENGINE_BATCH];
+    bool isBlocking[ENGINE_BATCH];
+
+    // Stat files, names too long for the header are left to the blocking path to report
+    for(size_t i=0; i < count; i++){
+        isBlocking[i] = strlen(basename(pathnames[i])) >= AR_NAME_SIZE;
+        if(!isBlocking[i]){
+            uringPrepare(ring, IORING_OP_STATX, AT_FDCWD, pathnames[i], STATX_BASIC_STATS, (uintptr_t)&files[i], engineData(i, ENGINE_OPEN));
+        }
+    }
+    engineSubmit(engine, results);
+
+    // Open, read and close each small regular file in one linked chain
+    for(size_t i=0; i < count; i++){
+        bodies[i] = NULL;
+        if(isBlocking[i] || results[engineData(i, ENGINE_OPEN)] < 0 || !S_ISREG(files[i].stx_mode) || files[i].stx_size > ENGINE_BODY_LIMIT){
+            isBlocking[i] = true;
+            continue;
+        }
+        bodies[i] = malloc(files[i].stx_size > 0 ? files[i].stx_size : 1);
+        struct io_uring_sqe *sqe = uringPrepare(ring, IORING_OP_OPENAT, AT_FDCWD, pathnames[i], 0, 0, engineData(i, ENGINE_OPEN));
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = i+1;
+        sqe->flags = IOSQE_IO_LINK;
+        if(files[i].stx_size > 0){
+            sqe = uringPrepare(ring, IORING_OP_READ, i, bodies[i], files[i].stx_size, 0, engineData(i, ENGINE_TRANSFER));
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+        }
+        sqe = uringPrepare(ring, IORING_OP_CLOSE, 0, NULL, 0, 0, engineData(i, ENGINE_CLOSE));
+        sqe->file_index = i+1;
+    }
+    engineSubmit(engine, results);
+
+    // Fill archived files in pathname order
+    for(size_t i=0; i < count; i++){
+        if(isBlocking[i]){
+            archivedFiles[i] = fileToArchivedFileStruct(pathnames[i], isCompressed);
+            continue;
+        }
+        if(results[engineData(i, ENGINE_OPEN)] < 0){
+            fprintf(stderr, "Error: Cannot read only open file \"%s\"\n", pathnames[i]);
+            exit(EXIT_FAILURE);
+        }
+        if(files[i].stx_size > 0 && results[engineData(i, ENGINE_TRANSFER)] != (int)files[i].stx_size){
+            fprintf(stderr, "Error: Cannot read from file \"%s\"\n", pathnames[i]);
+            exit(EXIT_FAILURE);
+        }
+        struct stat filedata = {
+            .st_mode = files[i].stx_mode,
+            .st_uid = files[i].stx_uid,
+            .st_gid = files[i].stx_gid,
+            .st_size = files[i].stx_size,
+            .st_mtime = files[i].stx_mtime.tv_sec,
+        };
+        archivedFiles[i] = statToArchivedFileStruct(pathnames[i], &filedata);
+        archivedFiles[i]->body = bodies[i];
+        if(isCompressed){
+            archivedFileCompress(archivedFiles[i]);
+        }
+    }
+}
+
+void engineSubmit(engineStruct *engine, int *results){
+    /**
+     * Submit prepared chains and collect every result by `engineData`
+     * :param engine: I/O engine with ring
+     * :param results: Destination of ENGINE_BATCH*ENGINE_STEPS results
+     * :return: None
+     */
+    if(uringSubmit(engine->ring) == -1){ // Error handling
+        fprintf(stderr, "Error: Cannot submit to io_uring\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t data;
+    int result;
+    while(uringComplete(engine->ring, &data, &result)){
+        results[data] = result;
+    }
+}
+
+uint64_t engineData(size_t i, int step){
+    /**
+     * Completion value of a chain entry, its position in the results
+     * :param i: File position in batch
+     * :param step: ENGINE_OPEN, ENGINE_TRANSFER or ENGINE_CLOSE
+     * :return: Completion value
+     */
+    return i*ENGINE_STEPS+step;
+}
@@ -1,11 +1,18 @@
 #include <stdio.h>
+#include <errno.h>
 #include "ar.h"
 
 
+#define FILE_MOVE_BUFFER_SIZE (1 << 20)
+
+
 void forceOpenCloseArchive(char *pathname);
+int openArchiveAppend(char *pathname);
 int openFileReadOnly(char *pathname);
+int openFileReadWrite(char *pathname);
 int openFileWriteOnlyTruncate(char *pathname);
 int openFileWriteOnlyCreateTruncate(char *pathname);
+void fileMoveRange(int fd, off_t source, off_t destination, off_t count, char *pathname);
 
 
 void forceOpenCloseArchive(char *pathname){
@@ -22,7 +29,7 @@ void forceOpenCloseArchive(char *pathname){
         if(bytesRead == -1){
             fprintf(stderr, "Error: Cannot read from file \"%s\"\n", pathname);
             exit(EXIT_FAILURE);
-        }else if(strcmp(buffer, ARMAG) != 0){
+        }else if(bytesRead != SARMAG || memcmp(buffer, ARMAG, SARMAG) != 0){
             fprintf(stderr, "Error: Non-archive file \"%s\"\n", pathname);
             exit(EXIT_FAILURE);
         }
@@ -42,6 +49,28 @@ void forceOpenCloseArchive(char *pathname){
     close(fd);
 }
 
+int openArchiveAppend(char *pathname){
+    /**
+     * Append only open file descriptor of existing archive
+     * :param pathname: Archive path
+     * :return: Append only open file descriptor
+     */
+    int fd = open(pathname, O_RDWR | O_APPEND, 0666);
+    if(fd == -1){
+        fprintf(stderr, "Error: Cannot append open file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+
+    // Confirm archive indicator
+    char buffer[SARMAG];
+    int bytesRead = pread(fd, buffer, SARMAG, 0);
+    if(bytesRead != SARMAG || memcmp(buffer, ARMAG, SARMAG) != 0){
+        fprintf(stderr, "Error: Non-archive file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
 int openFileReadOnly(char *pathname){
     /**
      * Read only open file descriptor
@@ -56,6 +85,20 @@ int openFileReadOnly(char *pathname){
     return fd;
 }
 
+int openFileReadWrite(char *pathname){
+    /**
+     * Read write open file descriptor
+     * :param pathname: File path
+     * :return: Read write open file descriptor
+     */
+    int fd = open(pathname, O_RDWR, 0666);
+    if(fd == -1){
+        fprintf(stderr, "Error: Cannot read write open file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
 int openFileWriteOnlyTruncate(char *pathname){
     /**
      * Write only open file descriptor
@@ -83,3 +126,55 @@ int openFileWriteOnlyCreateTruncate(char *pathname){
     }
     return fd;
 }
+
+void fileMoveRange(int fd, off_t source, off_t destination, off_t count, char *pathname){
+    /**
+     * Move file bytes down to a lower offset within the same file
+     * Uses in-kernel copy_file_range while the gap allows large
+     * non-overlapping chunks, otherwise pread/pwrite through a buffer
+     * :param fd: Read write open file descriptor
+     * :param source: File offset to move from
+     * :param destination: File offset to move to, below source
+     * :param count: Bytes to move
+     * :param pathname: File path for error reporting
+     * :return: None
+     */
+    off_t gap = source-destination;
+    while(count > 0 && gap >= FILE_MOVE_BUFFER_SIZE){ // Ranges within one call never overlap
+        loff_t in = source;
+        loff_t out = destination;
+        size_t chunk = count < gap ? count : gap;
+        ssize_t bytesCopied = copy_file_range(fd, &in, fd, &out, chunk, 0);
+        if(bytesCopied == -1 && errno == EINTR){
+            continue;
+        }else if(bytesCopied <= 0){ // Unsupported, fall back to buffered copy
+            break;
+        }
+        source += bytesCopied;
+        destination += bytesCopied;
+        count -= bytesCopied;
+    }
+
+    char *buffer = count > 0 ? malloc(FILE_MOVE_BUFFER_SIZE) : NULL;
+    while(count > 0){
+        size_t chunk = count < FILE_MOVE_BUFFER_SIZE ? count : FILE_MOVE_BUFFER_SIZE;
+        ssize_t bytesRead = pread(fd, buffer, chunk, source);
+        if(bytesRead <= 0){
+            fprintf(stderr, "Error: Cannot read from file \"%s\"\n", pathname);
+            exit(EXIT_FAILURE);
+        }
+        ssize_t bytesWritten = 0;
+        while(bytesWritten < bytesRead){
+            ssize_t bytes = pwrite(fd, buffer+bytesWritten, bytesRead-bytesWritten, destination+bytesWritten);
+            if(bytes <= 0){
+                fprintf(stderr, "Error: Cannot write to file \"%s\"\n", pathname);
+                exit(EXIT_FAILURE);
+            }
+            bytesWritten += bytes;
+        }
+        source += bytesRead;
+        destination += bytesRead;
+        count -= bytesRead;
+    }
+    free(buffer);
+}
@@ -0,0 +1,244 @@
+#include <endian.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+#define HASH_PRIME1 11400714785074694791ULL
+#define HASH_PRIME2 14029467366897019727ULL
+#define HASH_PRIME3 1609587929392839161ULL
+#define HASH_PRIME4 9650029242287828579ULL
+#define HASH_PRIME5 2870177450012600261ULL
+#define HASH_BLOCK_SIZE (1 << 20)
+
+
+/* XXH64 with seed 0, so hashes match the reference implementation. Input
+   words are read little endian. */
+
+typedef struct hashState{
+    uint64_t lanes[4];
+    uint64_t total; // bytes hashed
+    unsigned char stripe[32]; // bytes not yet hashed as a full stripe
+    size_t stripeSize;
+}hashStateStruct;
+
+
+uint64_t hashBytes(const void *buffer, size_t count);
+void hashInit(hashStateStruct *state);
+void hashUpdate(hashStateStruct *state, const void *buffer, size_t count);
+uint64_t hashDigest(hashStateStruct *state);
+int hashFile(int fd, off_t offset, off_t count, uint64_t *hash);
+uint64_t hashRotate(uint64_t value, int bits);
+uint64_t hashRound(uint64_t accumulator, uint64_t input);
+uint64_t hashMergeRound(uint64_t accumulator, uint64_t value);
+uint64_t hashRead64(const unsigned char *cur);
+uint32_t hashRead32(const unsigned char *cur);
+
+
+uint64_t hashBytes(const void *buffer, size_t count){
+    /**
+     * 64-bit content hash of buffer
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: Hash value
+     */
+    hashStateStruct state;
+    hashInit(&state);
+    hashUpdate(&state, buffer, count);
+    return hashDigest(&state);
+}
+
+void hashInit(hashStateStruct *state){
+    /**
+     * Start incremental content hash
+     * :param state: Hash state
+     * :return: None
+     */
+    state->lanes[0] = HASH_PRIME1+HASH_PRIME2;
+    state->lanes[1] = HASH_PRIME2;
+    state->lanes[2] = 0;
+    state->lanes[3] = -HASH_PRIME1;
+    state->total = 0;
+    state->stripeSize = 0;
+}
+
+void hashUpdate(hashStateStruct *state, const void *buffer, size_t count){
+    /**
+     * Hash next bytes, in any split, as if hashed in one buffer
+     * :param state: Hash state
+     * :param buffer: Source buffer
+     * :param count: Buffer size
+     * :return: None
+     */
+    const unsigned char *cur = buffer;
+    const unsigned char *end = cur+count;
+    state->total += count;
+
+    // Complete buffered stripe
+    if(state->stripeSize > 0){
+        size_t fill = 32-state->stripeSize;
+        if(fill > count){
+            fill = count;
+        }
+        memcpy(state->stripe+state->stripeSize, cur, fill);
+        state->stripeSize += fill;
+        cur += fill;
+        if(state->stripeSize < 32){
+            return;
+        }
+        for(int i=0; i < 4; i++){
+            state->lanes[i] = hashRound(state->lanes[i], hashRead64(state->stripe+8*i));
+        }
+        state->stripeSize = 0;
+    }
+
+    // Hash 32 byte stripes across four lanes
+    uint64_t v1 = state->lanes[0];
+    uint64_t v2 = state->lanes[1];
+    uint64_t v3 = state->lanes[2];
+    uint64_t v4 = state->lanes[3];
+    while(cur+32 <= end){
+        v1 = hashRound(v1, hashRead64(cur));
+        v2 = hashRound(v2, hashRead64(cur+8));
+        v3 = hashRound(v3, hashRead64(cur+16));
+        v4 = hashRound(v4, hashRead64(cur+24));
+        cur += 32;
+    }
+    state->lanes[0] = v1;
+    state->lanes[1] = v2;
+    state->lanes[2] = v3;
+    state->lanes[3] = v4;
+
+    memcpy(state->stripe, cur, end-cur);
+    state->stripeSize = end-cur;
+}
+
+uint64_t hashDigest(hashStateStruct *state){
+    /**
+     * Content hash of the bytes hashed so far
+     * :param state: Hash state
+     * :return: Hash value
+     */
+    const unsigned char *cur = state->stripe;
+    const unsigned char *end = cur+state->stripeSize;
+    uint64_t hash;
+    if(state->total >= 32){
+        uint64_t *lanes = state->lanes;
+        hash = hashRotate(lanes[0], 1)+hashRotate(lanes[1], 7)+hashRotate(lanes[2], 12)+hashRotate(lanes[3], 18);
+        for(int i=0; i < 4; i++){
+            hash = hashMergeRound(hash, lanes[i]);
+        }
+    }else{
+        hash = HASH_PRIME5;
+    }
+    hash += state->total;
+
+    // Hash remaining words and bytes
+    while(cur+8 <= end){
+        hash ^= hashRound(0, hashRead64(cur));
+        hash = hashRotate(hash, 27)*HASH_PRIME1+HASH_PRIME4;
+        cur += 8;
+    }
+    if(cur+4 <= end){
+        hash ^= hashRead32(cur)*HASH_PRIME1;
+        hash = hashRotate(hash, 23)*HASH_PRIME2+HASH_PRIME3;
+        cur += 4;
+    }
+    while(cur < end){
+        hash ^= *cur*HASH_PRIME5;
+        hash = hashRotate(hash, 11)*HASH_PRIME1;
+        cur++;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+int hashFile(int fd, off_t offset, off_t count, uint64_t *hash){
+    /**
+     * Content hash of file range, read one block at a time
+     * :param fd: Source open file descriptor
+     * :param offset: Source file offset
+     * :param count: Bytes to hash
+     * :param hash: Destination of hash value
+     * :return: Whole range was read
+     */
+    hashStateStruct state;
+    hashInit(&state);
+    char *buffer = malloc(HASH_BLOCK_SIZE);
+    off_t hashed = 0;
+    while(hashed < count){
+        size_t block = count-hashed < HASH_BLOCK_SIZE ? count-hashed : HASH_BLOCK_SIZE;
+        ssize_t bytesRead = pread(fd, buffer, block, offset+hashed);
+        if(bytesRead <= 0){
+            break;
+        }
+        hashUpdate(&state, buffer, bytesRead);
+        hashed += bytesRead;
+    }
+    free(buffer);
+    *hash = hashDigest(&state);
+    return hashed == count;
+}
+
+uint64_t hashRotate(uint64_t value, int bits){
+    /**
+     * Rotate left
+     * :param value: Value
+     * :param bits: Bits to rotate by, 1 to 63
+     * :return: Rotated value
+     */
+    return (value << bits) | (value >> (64-bits));
+}
+
+uint64_t hashRound(uint64_t accumulator, uint64_t input){
+    /**
+     * Mix one input word into lane accumulator
+     * :param accumulator: Lane accumulator
+     * :param input: Input word
+     * :return: Lane accumulator
+     */
+    accumulator += input*HASH_PRIME2;
+    accumulator = hashRotate(accumulator, 31);
+    return accumulator*HASH_PRIME1;
+}
+
+uint64_t hashMergeRound(uint64_t accumulator, uint64_t value){
+    /**
+     * Merge lane accumulator into hash
+     * :param accumulator: Hash
+     * :param value: Lane accumulator
+     * :return: Hash
+     */
+    accumulator ^= hashRound(0, value);
+    return accumulator*HASH_PRIME1+HASH_PRIME4;
+}
+
+uint64_t hashRead64(const unsigned char *cur){
+    /**
+     * Unaligned little endian 64-bit read
+     * :param cur: Source bytes
+     * :return: Word
+     */
+    uint64_t value;
+    memcpy(&value, cur, sizeof(value));
+    return le64toh(value);
+}
+
+uint32_t hashRead32(const unsigned char *cur){
+    /**
+     * Unaligned little endian 32-bit read
+     * :param cur: Source bytes
+     * :return: Word
+     */
+    uint32_t value;
+    memcpy(&value, cur, sizeof(value));
+    return le32toh(value);
+}
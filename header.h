@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "ar.h"
+
+
+#define HEADER_DECIMAL 10
+#define HEADER_OCTAL 8
+#define AR_SIZE_MAX 9999999999LL // widest ar_size, 10 decimal digits
+#define AR_MODE_COMPRESSED 01000000 // ar_mode bit above every st_mode bit, body compressed by -z, see lz.h
+
+
+/* Fixed width ar_hdr field codec. Numbers are left justified and space
+   padded, ar_mode in octal and every other field in decimal. Fields are
+   parsed without copying or NUL terminating them, and trailing NUL padding
+   written by earlier myar versions is accepted. */
+
+int headerParseField(const char *field, int fieldSize, int base, int64_t *value);
+int headerParseMode(const char *field, int fieldSize, int64_t *mode);
+int headerFormatField(char *field, int fieldSize, int base, int64_t value);
+void headerParseName(const struct ar_hdr *header, char *name);
+void headerFormatName(struct ar_hdr *header, const char *name);
+
+
+int headerParseField(const char *field, int fieldSize, int base, int64_t *value){
+    /**
+     * Read number from space padded fixed width field
+     * A blank field reads as 0, as GNU ar leaves unused fields blank
+     * :param field: Header field, not NUL terminated
+     * :param fieldSize: Field width
+     * :param base: HEADER_DECIMAL or HEADER_OCTAL
+     * :param value: Destination of field value
+     * :return: Field is a number that fits in 64 bits
+     */
+    int64_t result = 0;
+    int i = 0;
+    for(; i < fieldSize; i++){
+        unsigned digit = (unsigned char)field[i]-'0';
+        if(digit >= (unsigned)base){
+            break;
+        }
+        if(result > (INT64_MAX-(int64_t)digit)/base){ // Overflow
+            return 0;
+        }
+        result = result*base+digit;
+    }
+    for(; i < fieldSize; i++){
+        if(field[i] != ' ' && field[i] != '\0'){
+            return 0;
+        }
+    }
+    *value = result;
+    return 1;
+}
+
+int headerParseMode(const char *field, int fieldSize, int64_t *mode){
+    /**
+     * Read file mode field, octal with a decimal fallback
+     * Earlier myar versions wrote st_mode in decimal, which reads as the undefined octal file type 030000
+     * :param field: Header field, not NUL terminated
+     * :param fieldSize: Field width
+     * :param mode: Destination of file mode
+     * :return: Field is a number in either base
+     */
+    if(headerParseField(field, fieldSize, HEADER_OCTAL, mode) && (*mode & S_IFMT) != 030000){
+        return 1;
+    }
+    return headerParseField(field, fieldSize, HEADER_DECIMAL, mode);
+}
+
+int headerFormatField(char *field, int fieldSize, int base, int64_t value){
+    /**
+     * Write number into space padded fixed width field
+     * Digits are produced right to left, so the field is written once
+     * :param field: Destination header field
+     * :param fieldSize: Field width
+     * :param base: HEADER_DECIMAL or HEADER_OCTAL
+     * :param value: Field value
+     * :return: Value is non-negative and fits the field, field untouched otherwise
+     */
+    if(value < 0){
+        return 0;
+    }
+    char digits[24];
+    int length = 0;
+    do{
+        digits[sizeof(digits)-1-length] = '0'+value%base;
+        value /= base;
+        length++;
+    }while(value != 0);
+    if(length > fieldSize){
+        return 0;
+    }
+    memcpy(field, digits+sizeof(digits)-length, length);
+    memset(field+length, ' ', fieldSize-length);
+    return 1;
+}
+
+void headerParseName(const struct ar_hdr *header, char *name){
+    /**
+     * Archived file name without NUL, space or GNU slash terminators
+     * :param header: Archived file header
+     * :param name: Destination of at least sizeof(ar_name)+1 characters
+     * :return: None
+     */
+    int length = 0;
+    while(length < (int)sizeof(header->ar_name) && header->ar_name[length] != '\0'){
+        name[length] = header->ar_name[length];
+        length++;
+    }
+    while(length > 0 && name[length-1] == ' '){
+        length--;
+    }
+    if(length > 1 && name[length-1] == '/'){
+        length--;
+    }
+    name[length] = '\0';
+}
+
+void headerFormatName(struct ar_hdr *header, const char *name){
+    /**
+     * Write archived file name into space padded ar_name
+     * :param header: Destination header
+     * :param name: Archived file name shorter than ar_name
+     * :return: None
+     */
+    size_t length = strlen(name);
+    memcpy(header->ar_name, name, length);
+    memset(header->ar_name+length, ' ', sizeof(header->ar_name)-length);
+}
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+
+#define NAME_INDEX_NAME_SIZE 17
+#define NAME_INDEX_INITIAL_BUCKETS 64
+
+
+struct arena;
+
+typedef struct nameIndexEntry{
+    char name[NAME_INDEX_NAME_SIZE];
+    size_t position; // archived file position in the deque table
+    struct nameIndexEntry *next; // next entry of the same name, archive order
+    struct nameIndexEntry *nextName; // first entry of the next name in the bucket, first entries only
+    struct nameIndexEntry *tail; // last entry of the same name, first entries only
+}nameIndexEntryStruct;
+
+typedef struct nameIndex{
+    nameIndexEntryStruct **buckets;
+    size_t bucketCount; // power of two
+    size_t entryCount;
+    size_t nameCount; // distinct names, one chain each
+    struct arena *arena; // owns the entries, NULL if they are heap allocated
+}nameIndexStruct;
+
+
+nameIndexStruct *nameIndexCreate(struct arena *arena);
+void nameIndexFree(nameIndexStruct *index);
+unsigned long nameIndexHash(char *name);
+nameIndexEntryStruct **nameIndexFindHead(nameIndexStruct *index, char *name);
+void nameIndexGrow(nameIndexStruct *index);
+void nameIndexInsert(nameIndexStruct *index, char *name, size_t position);
+nameIndexEntryStruct *nameIndexFind(nameIndexStruct *index, char *name);
+nameIndexEntryStruct *nameIndexFindNext(nameIndexEntryStruct *entry);
+void nameIndexRemove(nameIndexStruct *index, char *name, size_t position);
+
+
+nameIndexStruct *nameIndexCreate(struct arena *arena){
+    /**
+     * Create empty hash index from archived file name to deque position
+     * :param arena: Arena to allocate entries from, NULL for the heap
+     * :return: Name index
+     */
+    nameIndexStruct *index = malloc(sizeof(nameIndexStruct));
+    index->bucketCount = NAME_INDEX_INITIAL_BUCKETS;
+    index->buckets = calloc(index->bucketCount, sizeof(nameIndexEntryStruct *));
+    index->entryCount = 0;
+    index->nameCount = 0;
+    index->arena = arena;
+    return index;
+}
+
+void nameIndexFree(nameIndexStruct *index){
+    /**
+     * Free name index heap memory
+     * :param index: Name index
+     * :return: None
+     */
+    if(index->arena == NULL){ // Arena entries are released with the arena
+        for(size_t i=0; i < index->bucketCount; i++){
+            nameIndexEntryStruct *head = index->buckets[i];
+            while(head != NULL){
+                nameIndexEntryStruct *nextName = head->nextName;
+                nameIndexEntryStruct *cur = head;
+                while(cur != NULL){
+                    nameIndexEntryStruct *next = cur->next;
+                    free(cur);
+                    cur = next;
+                }
+                head = nextName;
+            }
+        }
+    }
+    free(index->buckets);
+    free(index);
+}
+
+unsigned long nameIndexHash(char *name){
+    /**
+     * FNV-1a hash of archived file name
+     * :param name: Archived file name
+     * :return: Hash value
+     */
+    unsigned long hash = 14695981039346656037UL;
+    for(unsigned char *cur = (unsigned char *)name; *cur != '\0'; cur++){
+        hash ^= *cur;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+nameIndexEntryStruct **nameIndexFindHead(nameIndexStruct *index, char *name){
+    /**
+     * Link to the first entry of a name in its bucket
+     * :param index: Name index
+     * :param name: Archived file name
+     * :return: Link holding the first entry, or the NULL link ending the bucket
+     */
+    nameIndexEntryStruct **head = &index->buckets[nameIndexHash(name) & (index->bucketCount-1)];
+    while(*head != NULL && strcmp((*head)->name, name) != 0){
+        head = &(*head)->nextName;
+    }
+    return head;
+}
+
+void nameIndexGrow(nameIndexStruct *index){
+    /**
+     * Double name index buckets, moving each name's chain whole
+     * :param index: Name index
+     * :return: None
+     */
+    size_t bucketCount = index->bucketCount*2;
+    nameIndexEntryStruct **buckets = calloc(bucketCount, sizeof(nameIndexEntryStruct *));
+    for(size_t i=0; i < index->bucketCount; i++){
+        nameIndexEntryStruct *head = index->buckets[i];
+        while(head != NULL){
+            nameIndexEntryStruct *nextName = head->nextName;
+            nameIndexEntryStruct **bucket = &buckets[nameIndexHash(head->name) & (bucketCount-1)];
+            head->nextName = *bucket;
+            *bucket = head;
+            head = nextName;
+        }
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucketCount = bucketCount;
+}
+
+void nameIndexInsert(nameIndexStruct *index, char *name, size_t position){
+    /**
+     * Insert archived file name after any earlier archived files of that name
+     * Each name keeps its last entry, so copies of one name append in O(1)
+     * :param index: Name index
+     * :param name: Archived file name
+     * :param position: Archived file position in the deque table
+     * :return: None
+     */
+    if(index->nameCount >= index->bucketCount){
+        nameIndexGrow(index);
+    }
+    nameIndexEntryStruct *entry;
+    if(index->arena != NULL){
+        entry = arenaAlloc(index->arena, sizeof(nameIndexEntryStruct));
+    }else{
+        entry = malloc(sizeof(nameIndexEntryStruct));
+    }
+    strncpy(entry->name, name, NAME_INDEX_NAME_SIZE-1);
+    entry->name[NAME_INDEX_NAME_SIZE-1] = '\0';
+    entry->position = position;
+    entry->next = NULL;
+    entry->nextName = NULL;
+    entry->tail = entry;
+    nameIndexEntryStruct **head = nameIndexFindHead(index, entry->name);
+    if(*head != NULL){ // Later copy of a name
+        (*head)->tail->next = entry;
+        (*head)->tail = entry;
+    }else{
+        *head = entry;
+        index->nameCount++;
+    }
+    index->entryCount++;
+}
+
+nameIndexEntryStruct *nameIndexFind(nameIndexStruct *index, char *name){
+    /**
+     * First archived file with exactly matching name
+     * :param index: Name index
+     * :param name: Archived file name
+     * :return: Name index entry, NULL if not found
+     */
+    return *nameIndexFindHead(index, name);
+}
+
+nameIndexEntryStruct *nameIndexFindNext(nameIndexEntryStruct *entry){
+    /**
+     * Next archived file with the same name as entry
+     * :param entry: Name index entry
+     * :return: Name index entry, NULL if not found
+     */
+    return entry->next;
+}
+
+void nameIndexRemove(nameIndexStruct *index, char *name, size_t position){
+    /**
+     * Remove archived file position from name index
+     * :param index: Name index
+     * :param name: Archived file name
+     * :param position: Archived file position in the deque table
+     * :return: None
+     */
+    nameIndexEntryStruct **head = nameIndexFindHead(index, name);
+    nameIndexEntryStruct *first = *head;
+    if(first == NULL){
+        return;
+    }
+    nameIndexEntryStruct *previous = NULL;
+    nameIndexEntryStruct *cur = first;
+    while(cur != NULL && cur->position != position){
+        previous = cur;
+        cur = cur->next;
+    }
+    if(cur == NULL){
+        return;
+    }
+
+    if(previous != NULL){ // Later copy of a name
+        previous->next = cur->next;
+        if(first->tail == cur){
+            first->tail = previous;
+        }
+    }else if(cur->next != NULL){ // Next copy becomes the first entry
+        cur->next->nextName = cur->nextName;
+        cur->next->tail = cur->tail;
+        *head = cur->next;
+    }else{
+        *head = cur->nextName;
+        index->nameCount--;
+    }
+    if(index->arena == NULL){
+        free(cur);
+    }
+    index->entryCount--;
+}
@@ -0,0 +1,954 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "index.h"
+#include "header.h"
+#include "catalog.h"
+#include "hash.h"
+#include "writer.h"
+#include "lz.h"
+#include "libmyar.h"
+
+
+#define MYAR_INITIAL_CAPACITY 64
+
+
+typedef struct myarEntry{
+    struct ar_hdr header; // header as stored in the archive
+    myarMemberStruct member;
+    int isDeleted; // queued for deletion by the next commit
+}myarEntryStruct;
+
+typedef struct myarAppend{
+    struct ar_hdr header; // filled when the commit opens the source
+    char *pathname; // on-disk source, NULL if body holds the contents
+    char name[MYAR_NAME_SIZE+1];
+    char *body;
+    int64_t size;
+    int mode;
+    int fd; // source opened by the commit, or its compressed temporary file, -1 otherwise
+    char *stored; // body compressed by the commit, NULL otherwise
+    int64_t storedSize; // body bytes written by the commit
+    int isHashed; // hash holds the content hash of the body as written
+    uint64_t hash;
+}myarAppendStruct;
+
+struct myarArchive{
+    char *pathname;
+    int flags; // myarOpen flags
+    int fd; // archive opened read only
+    int64_t size; // archive file bytes when opened or last committed
+    mode_t permissions;
+    int64_t scanOffset; // archive file offset of the next header to read
+    int64_t catalogSize; // catalog member body bytes, -1 if none
+    myarEntryStruct *entries; // archived files read so far, archive order
+    size_t count;
+    size_t capacity;
+    size_t cursor; // next entry returned by myarNext
+    size_t deletedCount;
+    nameIndexStruct *index; // archived file name to entries position
+    myarAppendStruct *appends; // queued appends, commit order
+    size_t appendCount;
+    size_t appendCapacity;
+    int64_t blockMember; // header offset of the compressed archived file whose block is cached, -1 if none
+    int64_t blockPosition; // body position of the cached block
+    int64_t blockSize; // cached block bytes, 0 while seeking
+    int64_t blockNext; // archive file offset of the next block header
+    unsigned char *block; // cached decompressed block of LZ_BLOCK_SIZE bytes
+    unsigned char *compressed; // compressed block as read
+};
+
+
+int myarArchiveLoad(myarArchiveStruct *archive);
+void myarArchiveUnload(myarArchiveStruct *archive);
+int myarArchiveScan(myarArchiveStruct *archive);
+int myarArchiveLookup(myarArchiveStruct *archive, const char *name, size_t *position);
+int myarArchiveReadBlock(myarArchiveStruct *archive, const myarMemberStruct *member, int64_t position);
+myarAppendStruct *myarArchiveQueueAppend(myarArchiveStruct *archive, const char *name);
+int myarAppendPrepare(myarAppendStruct *append, int flags);
+void myarAppendRelease(myarAppendStruct *append);
+int myarArchiveCommitAppend(myarArchiveStruct *archive);
+int myarArchiveCommitRewrite(myarArchiveStruct *archive);
+int myarArchiveWriteCatalog(myarArchiveStruct *archive, writerStruct *writer);
+int myarAppendWrite(myarAppendStruct *append, writerStruct *writer);
+int myarWriterStatus(writerStruct *writer, int status);
+int myarReadAt(int fd, void *buffer, size_t count, int64_t offset);
+int myarValidName(const char *name);
+
+
+int myarOpen(const char *pathname, int flags, myarArchiveStruct **archive){
+    /**
+     * Open on-disk archive file, reading no further than its archive indicator
+     * :param pathname: On-disk archive file path
+     * :param flags: 0, or MYAR_CREATE and MYAR_COMPRESS or'ed together
+     * :param archive: Destination of archive handle, release it with myarClose
+     * :return: Status code
+     */
+    if(flags & MYAR_CREATE){
+        int fd = open(pathname, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(fd != -1){
+            writerStruct *writer = writerOpen(fd, NULL);
+            writerWrite(writer, ARMAG, SARMAG);
+            int status = myarWriterStatus(writer, MYAR_OK);
+            close(fd);
+            if(status != MYAR_OK){
+                int error = errno;
+                unlink(pathname);
+                errno = error;
+                return status;
+            }
+        }else if(errno != EEXIST){ // Error handling
+            return MYAR_ERROR_IO;
+        }
+    }
+
+    myarArchiveStruct *handle = calloc(1, sizeof(myarArchiveStruct));
+    handle->pathname = strdup(pathname);
+    handle->flags = flags;
+    handle->fd = -1;
+    int status = myarArchiveLoad(handle);
+    if(status != MYAR_OK){
+        myarClose(handle);
+        return status;
+    }
+    *archive = handle;
+    return MYAR_OK;
+}
+
+void myarClose(myarArchiveStruct *archive){
+    /**
+     * Close archive handle, discarding uncommitted appends and deletions
+     * :param archive: Archive handle
+     * :return: None
+     */
+    myarArchiveUnload(archive);
+    free(archive->block);
+    free(archive->compressed);
+    free(archive->pathname);
+    free(archive);
+}
+
+int myarNext(myarArchiveStruct *archive, myarMemberStruct *member){
+    /**
+     * Next archived file in archive order, reading its header on first visit
+     * :param archive: Archive handle
+     * :param member: Destination of archived file metadata
+     * :return: MYAR_OK, MYAR_END after the last archived file, or an error
+     */
+    if(archive->fd == -1){ // Error handling, a commit could not reopen the archive
+        errno = EBADF;
+        return MYAR_ERROR_IO;
+    }
+    while(1){
+        if(archive->cursor == archive->count){
+            int status = myarArchiveScan(archive);
+            if(status != MYAR_OK){
+                return status;
+            }
+        }
+        myarEntryStruct *entry = &archive->entries[archive->cursor++];
+        if(!entry->isDeleted){
+            *member = entry->member;
+            return MYAR_OK;
+        }
+    }
+}
+
+void myarRewind(myarArchiveStruct *archive){
+    /**
+     * Restart iteration at the first archived file, headers already read are kept
+     * :param archive: Archive handle
+     * :return: None
+     */
+    archive->cursor = 0;
+}
+
+int myarFind(myarArchiveStruct *archive, const char *name, myarMemberStruct *member){
+    /**
+     * First archived file with exactly matching name
+     * :param archive: Archive handle
+     * :param name: Archived file name
+     * :param member: Destination of archived file metadata
+     * :return: MYAR_OK, MYAR_ERROR_NOT_FOUND, or an error
+     */
+    size_t position;
+    int status = myarArchiveLookup(archive, name, &position);
+    if(status == MYAR_OK){
+        *member = archive->entries[position].member;
+    }
+    return status;
+}
+
+int myarRead(myarArchiveStruct *archive, const myarMemberStruct *member, int64_t position, void *buffer, size_t size, size_t *bytesRead){
+    /**
+     * Read archived file body into caller buffer
+     * A compressed archived file is decompressed one block at a time, and
+     * the last block read is kept on the handle so sequential reads
+     * decompress each block once. Its content hash is not checked
+     * :param archive: Archive handle
+     * :param member: Archived file from myarNext or myarFind since the last commit
+     * :param position: Body offset to read from, at most member->size
+     * :param buffer: Destination buffer
+     * :param size: Destination buffer bytes
+     * :param bytesRead: Destination of bytes read, less than size only at the end of the body
+     * :return: Status code
+     */
+    if(position < 0 || position > member->size){ // Error handling
+        return MYAR_ERROR_ARGUMENT;
+    }
+    int64_t remaining = member->size-position;
+    size_t count = (int64_t)size < remaining ? size : (size_t)remaining;
+    if(!member->isCompressed){
+        int status = myarReadAt(archive->fd, buffer, count, member->offset+sizeof(struct ar_hdr)+position);
+        if(status != MYAR_OK){
+            return status;
+        }
+        *bytesRead = count;
+        return MYAR_OK;
+    }
+
+    size_t total = 0;
+    while(total < count){
+        int status = myarArchiveReadBlock(archive, member, position+total);
+        if(status != MYAR_OK){
+            return status;
+        }
+        size_t start = position+total-archive->blockPosition;
+        size_t bytes = (size_t)archive->blockSize-start < count-total ? (size_t)archive->blockSize-start : count-total;
+        memcpy((char *)buffer+total, archive->block+start, bytes);
+        total += bytes;
+    }
+    *bytesRead = total;
+    return MYAR_OK;
+}
+
+int myarAppendFile(myarArchiveStruct *archive, const char *pathname){
+    /**
+     * Queue on-disk file to be appended by the next commit, like -q
+     * The file is read by the commit, with its metadata at that time
+     * :param archive: Archive handle
+     * :param pathname: On-disk unarchived file path
+     * :return: Status code
+     */
+    char *copy = strdup(pathname);
+    char *filename = basename(copy);
+    char name[MYAR_NAME_SIZE+1];
+    int valid = myarValidName(filename);
+    if(valid){
+        strcpy(name, filename);
+    }
+    free(copy);
+    if(!valid){ // Error handling
+        return MYAR_ERROR_NAME;
+    }
+    struct stat filedata;
+    if(stat(pathname, &filedata) == -1){ // Error handling
+        return MYAR_ERROR_IO;
+    }
+    if(filedata.st_size > AR_SIZE_MAX){ // Error handling
+        return MYAR_ERROR_LIMIT;
+    }
+    myarAppendStruct *append = myarArchiveQueueAppend(archive, name);
+    append->pathname = strdup(pathname);
+    return MYAR_OK;
+}
+
+int myarAppendBuffer(myarArchiveStruct *archive, const char *name, const void *buffer, size_t size, int mode){
+    /**
+     * Queue caller buffer to be appended by the next commit as an archived file
+     * :param archive: Archive handle
+     * :param name: Archived file name
+     * :param buffer: Archived file body, copied
+     * :param size: Archived file body bytes
+     * :param mode: Archived file mode, e.g. 0100644, AR_MODE_COMPRESSED is ignored
+     * :return: Status code
+     */
+    if(!myarValidName(name)){ // Error handling
+        return MYAR_ERROR_NAME;
+    }
+    if((int64_t)size > AR_SIZE_MAX){ // Error handling
+        return MYAR_ERROR_LIMIT;
+    }
+    myarAppendStruct *append = myarArchiveQueueAppend(archive, name);
+    append->body = malloc(size > 0 ? size : 1);
+    memcpy(append->body, buffer, size);
+    append->size = size;
+    append->mode = mode & ~AR_MODE_COMPRESSED;
+    return MYAR_OK;
+}
+
+int myarDelete(myarArchiveStruct *archive, const char *name){
+    /**
+     * Queue first archived file of name for deletion by the next commit, like -d
+     * :param archive: Archive handle
+     * :param name: Archived file name
+     * :return: MYAR_OK, MYAR_ERROR_NOT_FOUND, or an error
+     */
+    size_t position;
+    int status = myarArchiveLookup(archive, name, &position);
+    if(status == MYAR_OK){
+        archive->entries[position].isDeleted = 1;
+        archive->deletedCount++;
+    }
+    return status;
+}
+
+int myarCommit(myarArchiveStruct *archive){
+    /**
+     * Apply queued deletions and appends to the on-disk archive file
+     * Members from myarNext or myarFind are stale afterwards and iteration restarts
+     * :param archive: Archive handle
+     * :return: Status code, queued changes are kept if the commit fails
+     */
+    if(archive->deletedCount == 0 && archive->appendCount == 0){
+        return MYAR_OK;
+    }
+
+    // Both commit paths need every header
+    int status;
+    while((status = myarArchiveScan(archive)) == MYAR_OK);
+    if(status != MYAR_END){
+        return status;
+    }
+
+    // Open on-disk sources and compress, then write
+    status = MYAR_OK;
+    for(size_t i=0; i < archive->appendCount && status == MYAR_OK; i++){
+        status = myarAppendPrepare(&archive->appends[i], archive->flags);
+    }
+    if(status == MYAR_OK){
+        status = archive->deletedCount == 0 ? myarArchiveCommitAppend(archive) : myarArchiveCommitRewrite(archive);
+    }
+    int error = errno;
+    for(size_t i=0; i < archive->appendCount; i++){
+        myarAppendRelease(&archive->appends[i]);
+    }
+    if(status != MYAR_OK){
+        errno = error;
+        return status;
+    }
+
+    // Reread the committed archive
+    myarArchiveUnload(archive);
+    return myarArchiveLoad(archive);
+}
+
+const char *myarError(int status){
+    /**
+     * Describe status code
+     * :param status: Status code
+     * :return: Static description
+     */
+    switch(status){
+        case MYAR_OK:
+            return "Success";
+        case MYAR_END:
+            return "No more archived files";
+        case MYAR_ERROR_IO:
+            return strerror(errno);
+        case MYAR_ERROR_FORMAT:
+            return "Malformed archive";
+        case MYAR_ERROR_NOT_FOUND:
+            return "Archived file not found";
+        case MYAR_ERROR_NAME:
+            return "Archived file name is empty or too long";
+        case MYAR_ERROR_LIMIT:
+            return "File does not fit an archive header";
+        case MYAR_ERROR_ARGUMENT:
+            return "Position outside archived file";
+    }
+    return "Unknown status";
+}
+
+
+int myarArchiveLoad(myarArchiveStruct *archive){
+    /**
+     * Open archive file and check its archive indicator, no header is read
+     * On failure the archive is left closed
+     * :param archive: Archive handle with pathname and no open archive
+     * :return: Status code
+     */
+    archive->fd = open(archive->pathname, O_RDONLY);
+    struct stat filedata;
+    char magic[SARMAG];
+    int status = MYAR_OK;
+    if(archive->fd == -1 || fstat(archive->fd, &filedata) == -1){ // Error handling
+        status = MYAR_ERROR_IO;
+    }else{
+        ssize_t result = pread(archive->fd, magic, SARMAG, 0);
+        if(result == -1){ // Error handling
+            status = MYAR_ERROR_IO;
+        }else if(result != SARMAG || memcmp(magic, ARMAG, SARMAG) != 0){ // Error handling
+            status = MYAR_ERROR_FORMAT;
+        }
+    }
+    if(status != MYAR_OK){
+        int error = errno;
+        if(archive->fd != -1){
+            close(archive->fd);
+            archive->fd = -1;
+        }
+        errno = error;
+        return status;
+    }
+
+    archive->size = filedata.st_size;
+    archive->permissions = filedata.st_mode & 07777;
+    archive->scanOffset = SARMAG;
+    archive->catalogSize = -1;
+    archive->capacity = MYAR_INITIAL_CAPACITY;
+    archive->entries = malloc(archive->capacity*sizeof(myarEntryStruct));
+    archive->count = 0;
+    archive->cursor = 0;
+    archive->deletedCount = 0;
+    archive->index = nameIndexCreate(NULL);
+    archive->appendCapacity = 0;
+    archive->appendCount = 0;
+    archive->appends = NULL;
+    archive->blockMember = -1;
+    return MYAR_OK;
+}
+
+void myarArchiveUnload(myarArchiveStruct *archive){
+    /**
+     * Close archive file and release headers and queued changes
+     * :param archive: Archive handle
+     * :return: None
+     */
+    if(archive->fd != -1){
+        close(archive->fd);
+        archive->fd = -1;
+    }
+    for(size_t i=0; i < archive->appendCount; i++){
+        free(archive->appends[i].pathname);
+        free(archive->appends[i].body);
+    }
+    free(archive->appends);
+    archive->appends = NULL;
+    archive->appendCount = 0;
+    archive->appendCapacity = 0;
+    free(archive->entries);
+    archive->entries = NULL;
+    archive->count = 0;
+    archive->capacity = 0;
+    archive->cursor = 0;
+    archive->deletedCount = 0;
+    if(archive->index != NULL){
+        nameIndexFree(archive->index);
+        archive->index = NULL;
+    }
+}
+
+int myarArchiveScan(myarArchiveStruct *archive){
+    /**
+     * Read the next archived file header into the entries table
+     * A catalog member at the front of the archive is skipped
+     * :param archive: Archive handle
+     * :return: MYAR_OK, MYAR_END once every header is read, or an error
+     */
+    while(archive->scanOffset < archive->size){
+        struct ar_hdr header;
+        int64_t offset = archive->scanOffset;
+        ssize_t result = pread(archive->fd, &header, sizeof(header), offset);
+        if(result == -1){ // Error handling
+            return MYAR_ERROR_IO;
+        }
+        int64_t size, mode = 0, uid = 0, gid = 0, date = 0;
+        if(result != sizeof(header) || memcmp(header.ar_fmag, ARFMAG, sizeof(header.ar_fmag)) != 0 ||
+                !headerParseField(header.ar_size, sizeof(header.ar_size), HEADER_DECIMAL, &size) ||
+                offset+(int64_t)sizeof(header)+size > archive->size){ // Error handling
+            return MYAR_ERROR_FORMAT;
+        }
+        headerParseMode(header.ar_mode, sizeof(header.ar_mode), &mode);
+        headerParseField(header.ar_uid, sizeof(header.ar_uid), HEADER_DECIMAL, &uid);
+        headerParseField(header.ar_gid, sizeof(header.ar_gid), HEADER_DECIMAL, &gid);
+        headerParseField(header.ar_date, sizeof(header.ar_date), HEADER_DECIMAL, &date);
+
+        // Skip body and standard even padding
+        int64_t next = offset+sizeof(header)+size;
+        char padding;
+        if(next%2 == 1 && next < archive->size && pread(archive->fd, &padding, 1, next) == 1 && padding == '\n'){
+            next++;
+        }
+        if(offset == SARMAG && catalogIsHeader(&header)){
+            archive->scanOffset = next;
+            archive->catalogSize = size;
+            continue;
+        }
+
+        // Compressed body size is read from its frame
+        int64_t bodySize = size;
+        if(mode & AR_MODE_COMPRESSED){
+            unsigned char frame[LZ_FRAME_SIZE];
+            uint64_t frameSize, hash;
+            int status = size < LZ_FRAME_SIZE ? MYAR_ERROR_FORMAT : myarReadAt(archive->fd, frame, LZ_FRAME_SIZE, offset+sizeof(header));
+            if(status == MYAR_OK && (!lzReadFrame(frame, size, &frameSize, &hash) || frameSize > AR_SIZE_MAX)){ // Error handling
+                status = MYAR_ERROR_FORMAT;
+            }
+            if(status != MYAR_OK){
+                return status;
+            }
+            bodySize = frameSize;
+        }
+        archive->scanOffset = next;
+
+        if(archive->count == archive->capacity){
+            archive->capacity *= 2;
+            archive->entries = realloc(archive->entries, archive->capacity*sizeof(myarEntryStruct));
+        }
+        myarEntryStruct *entry = &archive->entries[archive->count];
+        entry->header = header;
+        headerParseName(&header, entry->member.name);
+        entry->member.size = bodySize;
+        entry->member.storedSize = size;
+        entry->member.isCompressed = (mode & AR_MODE_COMPRESSED) != 0;
+        entry->member.date = date;
+        entry->member.mode = mode & ~AR_MODE_COMPRESSED;
+        entry->member.uid = uid;
+        entry->member.gid = gid;
+        entry->member.offset = offset;
+        entry->isDeleted = 0;
+        nameIndexInsert(archive->index, entry->member.name, archive->count);
+        archive->count++;
+        return MYAR_OK;
+    }
+    return MYAR_END;
+}
+
+int myarArchiveLookup(myarArchiveStruct *archive, const char *name, size_t *position){
+    /**
+     * First archived file of name not queued for deletion, reading headers only until it is found
+     * :param archive: Archive handle
+     * :param name: Archived file name
+     * :param position: Destination of entries position
+     * :return: MYAR_OK, MYAR_ERROR_NOT_FOUND, or an error
+     */
+    if(archive->fd == -1){ // Error handling, a commit could not reopen the archive
+        errno = EBADF;
+        return MYAR_ERROR_IO;
+    }
+    nameIndexEntryStruct *cur = nameIndexFind(archive->index, (char *)name);
+    while(cur != NULL && archive->entries[cur->position].isDeleted){
+        cur = nameIndexFindNext(cur);
+    }
+    if(cur != NULL){
+        *position = cur->position;
+        return MYAR_OK;
+    }
+    int status;
+    while((status = myarArchiveScan(archive)) == MYAR_OK){
+        if(strcmp(archive->entries[archive->count-1].member.name, name) == 0){
+            *position = archive->count-1;
+            return MYAR_OK;
+        }
+    }
+    return status == MYAR_END ? MYAR_ERROR_NOT_FOUND : status;
+}
+
+int myarArchiveReadBlock(myarArchiveStruct *archive, const myarMemberStruct *member, int64_t position){
+    /**
+     * Cache the decompressed block of a compressed archived file holding a
+     * body position, see lz.h
+     * Every block but the last holds LZ_BLOCK_SIZE bytes, so blocks before
+     * the position are skipped by their block headers alone. Reading
+     * backwards restarts at the first block
+     * :param archive: Archive handle
+     * :param member: Compressed archived file
+     * :param position: Body offset, less than member->size
+     * :return: Status code
+     */
+    if(archive->blockMember != member->offset || position < archive->blockPosition){
+        archive->blockMember = member->offset;
+        archive->blockPosition = 0;
+        archive->blockSize = 0;
+        archive->blockNext = member->offset+sizeof(struct ar_hdr)+LZ_FRAME_SIZE;
+    }
+    if(archive->block == NULL){
+        archive->block = malloc(LZ_BLOCK_SIZE);
+        archive->compressed = malloc(LZ_BLOCK_SIZE);
+    }
+    int64_t end = member->offset+sizeof(struct ar_hdr)+member->storedSize;
+    while(position >= archive->blockPosition+archive->blockSize){
+        archive->blockPosition += archive->blockSize;
+        archive->blockSize = 0;
+        unsigned char word[LZ_BLOCK_HEADER_SIZE];
+        int status = archive->blockNext+LZ_BLOCK_HEADER_SIZE > end ? MYAR_ERROR_FORMAT : myarReadAt(archive->fd, word, LZ_BLOCK_HEADER_SIZE, archive->blockNext);
+        if(status != MYAR_OK){
+            archive->blockMember = -1;
+            return status;
+        }
+        uint32_t length = lzRead32(word) & ~LZ_STORED;
+        int64_t data = archive->blockNext+LZ_BLOCK_HEADER_SIZE;
+        if(length == 0 || length > LZ_BLOCK_SIZE || data+length > end){ // Error handling
+            archive->blockMember = -1;
+            return MYAR_ERROR_FORMAT;
+        }
+        archive->blockNext = data+length;
+        if(position-archive->blockPosition >= LZ_BLOCK_SIZE){ // Before the position, skip
+            archive->blockPosition += LZ_BLOCK_SIZE;
+            continue;
+        }
+
+        long bytes = length;
+        if(lzRead32(word) & LZ_STORED){
+            status = myarReadAt(archive->fd, archive->block, length, data);
+        }else{
+            status = myarReadAt(archive->fd, archive->compressed, length, data);
+            bytes = status == MYAR_OK ? lzDecompressBlock(archive->compressed, length, archive->block, LZ_BLOCK_SIZE) : 0;
+            if(status == MYAR_OK && bytes <= 0){ // Error handling
+                status = MYAR_ERROR_FORMAT;
+            }
+        }
+        if(status != MYAR_OK){
+            archive->blockMember = -1;
+            return status;
+        }
+        archive->blockSize = bytes;
+    }
+    return MYAR_OK;
+}
+
+myarAppendStruct *myarArchiveQueueAppend(myarArchiveStruct *archive, const char *name){
+    /**
+     * Queue empty append of archived file name
+     * :param archive: Archive handle
+     * :param name: Valid archived file name
+     * :return: Queued append, valid until the next append
+     */
+    if(archive->appendCount == archive->appendCapacity){
+        archive->appendCapacity = archive->appendCapacity > 0 ? archive->appendCapacity*2 : MYAR_INITIAL_CAPACITY;
+        archive->appends = realloc(archive->appends, archive->appendCapacity*sizeof(myarAppendStruct));
+    }
+    myarAppendStruct *append = &archive->appends[archive->appendCount++];
+    memset(append, 0, sizeof(myarAppendStruct));
+    strcpy(append->name, name);
+    append->fd = -1;
+    return append;
+}
+
+int myarAppendPrepare(myarAppendStruct *append, int flags){
+    /**
+     * Open on-disk source of append, compress it with MYAR_COMPRESS and
+     * fill its archived file header
+     * The body is kept as is unless compression makes it smaller. An
+     * on-disk source is compressed into an unnamed temporary file
+     * :param append: Queued append
+     * :param flags: Archive handle flags
+     * :return: Status code
+     */
+    int64_t date = time(NULL), uid = getuid(), gid = getgid(), mode = append->mode;
+    if(append->pathname != NULL){
+        struct stat filedata;
+        append->fd = open(append->pathname, O_RDONLY);
+        if(append->fd == -1 || fstat(append->fd, &filedata) == -1){ // Error handling
+            return MYAR_ERROR_IO;
+        }
+        date = filedata.st_mtime;
+        uid = filedata.st_uid;
+        gid = filedata.st_gid;
+        mode = filedata.st_mode;
+        append->size = filedata.st_size;
+    }
+    if(append->size > AR_SIZE_MAX){ // Error handling
+        return MYAR_ERROR_LIMIT;
+    }
+    append->storedSize = append->size;
+
+    // Compress, see lz.h
+    if((flags & MYAR_COMPRESS) && append->size > LZ_FRAME_SIZE){
+        if(append->body != NULL){
+            append->stored = malloc(LZ_BODY_CAPACITY(append->size));
+            append->storedSize = lzCompressBody((unsigned char *)append->body, append->size, hashBytes(append->body, append->size), (unsigned char *)append->stored);
+            if(append->storedSize == 0){
+                free(append->stored);
+                append->stored = NULL;
+                append->storedSize = append->size;
+            }
+        }else{
+            off_t length;
+            int fd = lzCompressFile(append->fd, append->size, &length);
+            if(length == -1){ // Error handling
+                return MYAR_ERROR_IO;
+            }
+            if(fd != -1){
+                close(append->fd);
+                append->fd = fd;
+                append->storedSize = length;
+            }
+        }
+        if(append->storedSize < append->size){
+            mode |= AR_MODE_COMPRESSED;
+        }
+    }
+
+    // Content hash of a body held in memory, for the catalog
+    if(append->stored != NULL || append->body != NULL){
+        append->isHashed = 1;
+        append->hash = append->stored != NULL ? hashBytes(append->stored, append->storedSize) : hashBytes(append->body, append->size);
+    }
+
+    struct ar_hdr *header = &append->header;
+    headerFormatName(header, append->name);
+    if(!headerFormatField(header->ar_date, sizeof(header->ar_date), HEADER_DECIMAL, date) ||
+            !headerFormatField(header->ar_uid, sizeof(header->ar_uid), HEADER_DECIMAL, uid) ||
+            !headerFormatField(header->ar_gid, sizeof(header->ar_gid), HEADER_DECIMAL, gid) ||
+            !headerFormatField(header->ar_mode, sizeof(header->ar_mode), HEADER_OCTAL, mode) ||
+            !headerFormatField(header->ar_size, sizeof(header->ar_size), HEADER_DECIMAL, append->storedSize)){ // Error handling
+        return MYAR_ERROR_LIMIT;
+    }
+    memcpy(header->ar_fmag, ARFMAG, sizeof(header->ar_fmag));
+    return MYAR_OK;
+}
+
+void myarAppendRelease(myarAppendStruct *append){
+    /**
+     * Close on-disk source and free compressed body of append after a commit
+     * attempt, so a failed commit can be retried
+     * :param append: Queued append
+     * :return: None
+     */
+    if(append->fd != -1){
+        close(append->fd);
+        append->fd = -1;
+    }
+    free(append->stored);
+    append->stored = NULL;
+    append->isHashed = 0;
+}
+
+int myarArchiveCommitAppend(myarArchiveStruct *archive){
+    /**
+     * Append queued archived files in place, truncating back on failure
+     * A catalog member stays valid, readers scan archived files past its end
+     * :param archive: Archive handle with every header read
+     * :return: Status code
+     */
+    int fd = open(archive->pathname, O_WRONLY);
+    if(fd == -1){ // Error handling
+        return MYAR_ERROR_IO;
+    }
+    if(lseek(fd, archive->size, SEEK_SET) == -1){ // Error handling
+        int error = errno;
+        close(fd);
+        errno = error;
+        return MYAR_ERROR_IO;
+    }
+    writerStruct *writer = writerOpen(fd, NULL);
+    if(archive->size%2 == 1){ // Archive written without final padding
+        writerWrite(writer, "\n", 1);
+    }
+    int status = MYAR_OK;
+    for(size_t i=0; i < archive->appendCount && status == MYAR_OK; i++){
+        status = myarAppendWrite(&archive->appends[i], writer);
+    }
+    status = myarWriterStatus(writer, status);
+    if(status != MYAR_OK){
+        int error = errno;
+        if(ftruncate(fd, archive->size) == -1){
+            // Nothing more to do, report the original error
+        }
+        errno = error;
+    }
+    close(fd);
+    return status;
+}
+
+int myarArchiveCommitRewrite(myarArchiveStruct *archive){
+    /**
+     * Write kept and queued archived files beside the archive and rename over it
+     * :param archive: Archive handle with every header read
+     * :return: Status code
+     */
+    size_t length = strlen(archive->pathname)+sizeof(".XXXXXX");
+    char *temporary = malloc(length);
+    if(temporary == NULL){ // Error handling
+        errno = ENOMEM;
+        return MYAR_ERROR_IO;
+    }
+    snprintf(temporary, length, "%s.XXXXXX", archive->pathname);
+    int fd = mkstemp(temporary);
+    if(fd == -1){ // Error handling
+        free(temporary);
+        return MYAR_ERROR_IO;
+    }
+
+    int status = fchmod(fd, archive->permissions) == -1 ? MYAR_ERROR_IO : MYAR_OK;
+    writerStruct *writer = writerOpen(fd, NULL);
+    writerWrite(writer, ARMAG, SARMAG);
+    if(status == MYAR_OK && archive->catalogSize >= 0){
+        status = myarArchiveWriteCatalog(archive, writer);
+    }
+    for(size_t i=0; i < archive->count && status == MYAR_OK && writer->error == 0; i++){
+        myarEntryStruct *entry = &archive->entries[i];
+        if(entry->isDeleted){
+            continue;
+        }
+        int64_t size = entry->member.storedSize;
+        writerWrite(writer, &entry->header, sizeof(struct ar_hdr));
+        if(writerCopy(writer, archive->fd, entry->member.offset+sizeof(struct ar_hdr), size) != size && writer->error == 0){ // Error handling
+            status = MYAR_ERROR_FORMAT;
+        }
+        if(size%2 == 1){ // Standard even padding
+            writerWrite(writer, "\n", 1);
+        }
+    }
+    for(size_t i=0; i < archive->appendCount && status == MYAR_OK; i++){
+        status = myarAppendWrite(&archive->appends[i], writer);
+    }
+    status = myarWriterStatus(writer, status);
+    if(close(fd) == -1 && status == MYAR_OK){ // Error handling
+        status = MYAR_ERROR_IO;
+    }
+    if(status == MYAR_OK && rename(temporary, archive->pathname) == -1){ // Error handling
+        status = MYAR_ERROR_IO;
+    }
+    if(status != MYAR_OK){
+        int error = errno;
+        unlink(temporary);
+        errno = error;
+    }
+    free(temporary);
+    return status;
+}
+
+int myarArchiveWriteCatalog(myarArchiveStruct *archive, writerStruct *writer){
+    /**
+     * Write fresh catalog member covering kept and queued archived files
+     * Content hashes of kept archived files are carried over from the
+     * catalog being replaced when its record still matches the header, and
+     * appends held in memory are hashed, the rest are left for -u to compute
+     * :param archive: Archive handle with every header read and appends prepared
+     * :param writer: Destination archive writer, past the archive indicator
+     * :return: Status code
+     */
+    // Read the catalog being replaced
+    char *previous = malloc(archive->catalogSize > 0 ? archive->catalogSize : 1);
+    size_t previousCount = 0;
+    off_t previousEnd;
+    int status = myarReadAt(archive->fd, previous, archive->catalogSize, SARMAG+sizeof(struct ar_hdr));
+    if(status == MYAR_ERROR_IO){
+        free(previous);
+        return status;
+    }
+    if(status != MYAR_OK || !catalogReadPreamble(previous, archive->catalogSize, &previousCount, &previousEnd)){ // Stale or malformed, hashes are recomputed
+        previousCount = 0;
+    }
+
+    size_t count = archive->count-archive->deletedCount+archive->appendCount;
+    size_t bodySize = catalogBodySize(count);
+    char *body = malloc(bodySize);
+    int64_t memberOffset = SARMAG+sizeof(struct ar_hdr)+bodySize;
+    size_t record = 0;
+    size_t cur = 0; // previous catalog record, both are in archive order
+    for(size_t i=0; i < archive->count; i++){
+        myarEntryStruct *entry = &archive->entries[i];
+        if(entry->isDeleted){
+            continue;
+        }
+        while(cur < previousCount && catalogParseField(catalogRecord(previous, cur)->cr_offset, sizeof(catalogRecord(previous, cur)->cr_offset)) < entry->member.offset){
+            cur++;
+        }
+        catalogRecordStruct *match = cur < previousCount ? catalogRecord(previous, cur) : NULL;
+        uint64_t hash = 0;
+        int isHashed = match != NULL && catalogParseField(match->cr_offset, sizeof(match->cr_offset)) == entry->member.offset &&
+                memcmp(&match->cr_hdr, &entry->header, sizeof(struct ar_hdr)) == 0 && catalogRecordHash(match, &hash);
+        catalogWriteRecord(body, record++, memberOffset, &entry->header, isHashed, hash);
+        memberOffset += sizeof(struct ar_hdr)+entry->member.storedSize+entry->member.storedSize%2;
+    }
+    free(previous);
+    for(size_t i=0; i < archive->appendCount; i++){
+        myarAppendStruct *append = &archive->appends[i];
+        catalogWriteRecord(body, record++, memberOffset, &append->header, append->isHashed, append->hash);
+        memberOffset += sizeof(struct ar_hdr)+append->storedSize+append->storedSize%2;
+    }
+    catalogWritePreamble(body, bodySize, count, memberOffset);
+
+    struct ar_hdr header;
+    catalogHeader(&header, bodySize);
+    writerWrite(writer, &header, sizeof(header));
+    writerWrite(writer, body, bodySize);
+    writerFlush(writer);
+    free(body);
+    return MYAR_OK;
+}
+
+int myarAppendWrite(myarAppendStruct *append, writerStruct *writer){
+    /**
+     * Queue prepared append as an archived file on archive writer
+     * Bodies held in memory are written by the next flush
+     * :param append: Queued append with its header filled
+     * :param writer: Destination archive writer
+     * :return: Status code, MYAR_ERROR_FORMAT if an on-disk source ends early
+     */
+    writerWrite(writer, &append->header, sizeof(struct ar_hdr));
+    if(append->stored != NULL){
+        writerWrite(writer, append->stored, append->storedSize);
+    }else if(append->body != NULL){
+        writerWrite(writer, append->body, append->size);
+    }else if(writerCopy(writer, append->fd, 0, append->storedSize) != append->storedSize && writer->error == 0){ // Error handling
+        return MYAR_ERROR_FORMAT;
+    }
+    if(append->storedSize%2 == 1){ // Standard even padding
+        writerWrite(writer, "\n", 1);
+    }
+    return MYAR_OK;
+}
+
+int myarWriterStatus(writerStruct *writer, int status){
+    /**
+     * Close archive writer, flushing it, and merge its failed write into status
+     * :param writer: Archive writer opened without pathname
+     * :param status: Status code so far
+     * :return: Status code, MYAR_ERROR_IO with errno set if a write failed first
+     */
+    int error = writerClose(writer);
+    if(status == MYAR_OK && error != 0){
+        errno = error;
+        return MYAR_ERROR_IO;
+    }
+    return status;
+}
+
+int myarReadAt(int fd, void *buffer, size_t count, int64_t offset){
+    /**
+     * Read whole buffer at offset
+     * :param fd: Source file
+     * :param buffer: Destination buffer
+     * :param count: Bytes to read
+     * :param offset: Source offset
+     * :return: Status code, MYAR_ERROR_FORMAT if the file ends early
+     */
+    size_t total = 0;
+    while(total < count){
+        ssize_t result = pread(fd, (char *)buffer+total, count-total, offset+total);
+        if(result == -1 && errno == EINTR){
+            continue;
+        }
+        if(result == -1){ // Error handling
+            return MYAR_ERROR_IO;
+        }
+        if(result == 0){ // Error handling
+            return MYAR_ERROR_FORMAT;
+        }
+        total += result;
+    }
+    return MYAR_OK;
+}
+
+int myarValidName(const char *name){
+    /**
+     * Archived file name fits ar_name with its terminator, as myar writes it
+     * :param name: Archived file name
+     * :return: Is valid
+     */
+    size_t length = strlen(name);
+    return length > 0 && length < MYAR_NAME_SIZE;
+}
@@ -0,0 +1,72 @@
+#ifndef LIBMYAR_H
+#define LIBMYAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define MYAR_OK 0
+#define MYAR_END 1 // iteration reached the last archived file
+#define MYAR_ERROR_IO -1 // system call failed, errno holds the cause
+#define MYAR_ERROR_FORMAT -2 // not an archive, or a malformed or truncated header
+#define MYAR_ERROR_NOT_FOUND -3 // no archived file of that name
+#define MYAR_ERROR_NAME -4 // name is empty or does not fit ar_name
+#define MYAR_ERROR_LIMIT -5 // metadata or size does not fit the archive header
+#define MYAR_ERROR_ARGUMENT -6 // read position outside the archived file
+
+#define MYAR_CREATE 1 // myarOpen creates an empty archive if none exists
+#define MYAR_COMPRESS 2 // myarCommit compresses appended files like myar -z
+
+#define MYAR_NAME_SIZE 16
+
+#define MYAR_API __attribute__((visibility("default"))) // the shared library hides everything else
+
+
+/* Embeddable myar archive API. Every call returns MYAR_OK or a status code
+   and never exits the process, so a long-running process can work on
+   archives without a fork/exec of myar per operation.
+
+   Archived file headers are read lazily: myarNext and myarFind read only as
+   far into the archive as they need, and bodies are read on demand into
+   caller buffers. Appends and deletions are queued on the handle and applied
+   by myarCommit, which appends in place when nothing was deleted and
+   otherwise writes a new archive beside the original and renames it over
+   it, so a failed commit leaves the archive untouched. Until then the
+   archive is only read, and archived files queued for deletion are skipped
+   by iteration.
+
+   Archived files compressed by myar -z, or appended with MYAR_COMPRESS,
+   are listed with their uncompressed size and decompressed by myarRead.
+   Like myar -z, an appended file is kept compressed only if that makes it
+   smaller.
+
+   A handle is not thread safe, use one handle per thread. */
+
+typedef struct myarArchive myarArchiveStruct;
+
+typedef struct myarMember{
+    char name[MYAR_NAME_SIZE+1];
+    int64_t size; // body bytes, uncompressed
+    int64_t storedSize; // body bytes in the archive, less than size if compressed
+    int isCompressed;
+    int64_t date;
+    int mode; // without the compressed member bit
+    int uid;
+    int gid;
+    int64_t offset; // archive file offset of header, identifies the archived file
+}myarMemberStruct;
+
+
+MYAR_API int myarOpen(const char *pathname, int flags, myarArchiveStruct **archive);
+MYAR_API void myarClose(myarArchiveStruct *archive);
+MYAR_API int myarNext(myarArchiveStruct *archive, myarMemberStruct *member);
+MYAR_API void myarRewind(myarArchiveStruct *archive);
+MYAR_API int myarFind(myarArchiveStruct *archive, const char *name, myarMemberStruct *member);
+MYAR_API int myarRead(myarArchiveStruct *archive, const myarMemberStruct *member, int64_t position, void *buffer, size_t size, size_t *bytesRead);
+MYAR_API int myarAppendFile(myarArchiveStruct *archive, const char *pathname);
+MYAR_API int myarAppendBuffer(myarArchiveStruct *archive, const char *name, const void *buffer, size_t size, int mode);
+MYAR_API int myarDelete(myarArchiveStruct *archive, const char *name);
+MYAR_API int myarCommit(myarArchiveStruct *archive);
+MYAR_API const char *myarError(int status);
+
+#endif
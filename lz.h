@@ -0,0 +1,454 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+#define LZ_MAGIC "\x89MYARLZ\n"
+#define LZ_MAGIC_SIZE 8
+#define LZ_FRAME_SIZE 24 // magic, uncompressed size and content hash
+#define LZ_BLOCK_HEADER_SIZE 4
+#define LZ_BLOCK_SIZE (1 << 20) // uncompressed bytes per block
+#define LZ_STORED 0x80000000u // block header flag, block kept uncompressed
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // a block ends with at least this many literals
+#define LZ_MATCH_LIMIT 12 // no match starts this close to the end of a block
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 16
+#define LZ_WILD_COPY 16 // copy granularity when the buffers have room past the end
+#define LZ_FAST_ROOM 64 // output room for a short sequence copied in fixed size chunks
+#define LZ_BODY_CAPACITY(size) (LZ_FRAME_SIZE+((size)+LZ_BLOCK_SIZE-1)/LZ_BLOCK_SIZE*LZ_BLOCK_HEADER_SIZE+(size)) // `lzCompressBody` destination bytes
+
+
+/* Compressed member body, written by -z. The frame is followed by blocks
+   of at most LZ_BLOCK_SIZE uncompressed bytes, each a 4 byte little endian
+   size, with LZ_STORED set if the block did not shrink, and its data. To
+   other ar implementations the member is an opaque file.
+
+       frame    magic[8] size[8] hash[8]     uncompressed size, XXH64
+       block    size[4] data[size]
+
+   Blocks are LZ77 sequences in the LZ4 block layout: a token whose high
+   nibble is the literal count and low nibble the match length less 4, each
+   extended by 255 valued bytes when 15, then the literals, then a 2 byte
+   little endian match offset. The last sequence is literals only. Content
+   hashes are computed with hash.h, which is included before this file. */
+
+size_t lzCompressBody(const unsigned char *source, size_t size, uint64_t hash, unsigned char *destination);
+int lzCompressFile(int fd, off_t size, off_t *length);
+size_t lzWriteBlock(const unsigned char *source, size_t count, unsigned char *destination);
+size_t lzCompressBlock(const unsigned char *source, size_t count, unsigned char *destination, size_t capacity);
+long lzDecompressBlock(const unsigned char *source, size_t count, unsigned char *destination, size_t capacity);
+unsigned char *lzWriteLength(unsigned char *cur, unsigned char *end, size_t length);
+size_t lzMatchLength(const unsigned char *match, const unsigned char *cur, size_t length, size_t limit);
+void lzWildCopy(unsigned char *destination, const unsigned char *source, size_t count);
+long lzDecompressFrame(const unsigned char *body, size_t count, unsigned char *destination, size_t capacity);
+void lzWriteFrame(unsigned char *frame, uint64_t size, uint64_t hash);
+int lzReadFrame(const unsigned char *frame, size_t count, uint64_t *size, uint64_t *hash);
+void lzWrite32(unsigned char *cur, uint32_t value);
+uint32_t lzRead32(const unsigned char *cur);
+
+
+size_t lzCompressBody(const unsigned char *source, size_t size, uint64_t hash, unsigned char *destination){
+    /**
+     * Compress whole member body held in memory into a frame and blocks
+     * :param source: Uncompressed body
+     * :param size: Uncompressed bytes
+     * :param hash: Content hash of the uncompressed body, see hash.h
+     * :param destination: Destination of LZ_BODY_CAPACITY(size) bytes
+     * :return: Compressed body bytes, 0 if compression does not make it smaller
+     */
+    size_t length = LZ_FRAME_SIZE;
+    for(size_t offset=0; offset < size && length < size; offset += LZ_BLOCK_SIZE){
+        size_t count = size-offset < LZ_BLOCK_SIZE ? size-offset : LZ_BLOCK_SIZE;
+        length += lzWriteBlock(source+offset, count, destination+length);
+    }
+    if(length >= size){
+        return 0;
+    }
+    lzWriteFrame(destination, size, hash);
+    return length;
+}
+
+int lzCompressFile(int fd, off_t size, off_t *length){
+    /**
+     * Compress file into an unnamed temporary file one block at a time
+     * Compression stops at once if the first block does not shrink, and a
+     * temporary file that cannot be written is given up on like one that
+     * does not shrink
+     * :param fd: Source open file descriptor
+     * :param size: Source bytes
+     * :param length: Destination of compressed body bytes, -1 if the source cannot be read
+     * :return: Temporary file holding the compressed body, -1 if there is none
+     */
+    *length = LZ_FRAME_SIZE;
+    int out = open(P_tmpdir, O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+    if(out == -1){ // No temporary file, keep the file as is
+        return -1;
+    }
+    hashStateStruct state;
+    hashInit(&state);
+    unsigned char *source = malloc(LZ_BLOCK_SIZE);
+    unsigned char *block = malloc(LZ_BLOCK_HEADER_SIZE+LZ_BLOCK_SIZE);
+    for(off_t offset=0; offset < size && *length < size; offset += LZ_BLOCK_SIZE){
+        size_t count = size-offset < LZ_BLOCK_SIZE ? size-offset : LZ_BLOCK_SIZE;
+        if(pread(fd, source, count, offset) != (ssize_t)count){ // Error handling
+            *length = -1;
+            break;
+        }
+        hashUpdate(&state, source, count);
+        size_t blockLength = lzWriteBlock(source, count, block);
+        if((offset == 0 && blockLength > count) || // Already compressed data, give up early
+                pwrite(out, block, blockLength, *length) != (ssize_t)blockLength){
+            *length = size;
+            break;
+        }
+        *length += blockLength;
+    }
+    free(source);
+    free(block);
+    unsigned char frame[LZ_FRAME_SIZE];
+    lzWriteFrame(frame, size, hashDigest(&state));
+    if(*length == -1 || *length >= size || pwrite(out, frame, LZ_FRAME_SIZE, 0) != LZ_FRAME_SIZE){
+        close(out);
+        return -1;
+    }
+    return out;
+}
+
+size_t lzWriteBlock(const unsigned char *source, size_t count, unsigned char *destination){
+    /**
+     * Compress block with its block header, stored as is if it does not shrink
+     * :param source: Uncompressed block
+     * :param count: Uncompressed bytes, at most LZ_BLOCK_SIZE
+     * :param destination: Destination of LZ_BLOCK_HEADER_SIZE+count bytes
+     * :return: Block bytes written, header included
+     */
+    size_t length = lzCompressBlock(source, count, destination+LZ_BLOCK_HEADER_SIZE, count-1);
+    if(length == 0){ // Incompressible
+        memcpy(destination+LZ_BLOCK_HEADER_SIZE, source, count);
+        lzWrite32(destination, count | LZ_STORED);
+        return LZ_BLOCK_HEADER_SIZE+count;
+    }
+    lzWrite32(destination, length);
+    return LZ_BLOCK_HEADER_SIZE+length;
+}
+
+size_t lzCompressBlock(const unsigned char *source, size_t count, unsigned char *destination, size_t capacity){
+    /**
+     * Compress block with greedy hash table matching
+     * The table is sized to the block, so small files stay cheap
+     * :param source: Uncompressed block
+     * :param count: Uncompressed bytes, at most LZ_BLOCK_SIZE
+     * :param destination: Compressed block
+     * :param capacity: Destination bytes
+     * :return: Compressed bytes, 0 if they do not fit capacity
+     */
+    int bits = 8;
+    while(bits < LZ_HASH_BITS && ((size_t)1 << bits) < count){
+        bits++;
+    }
+    uint32_t *table = calloc((size_t)1 << bits, sizeof(uint32_t)); // position+1 of last 4 bytes with that hash
+    unsigned char *cur = destination, *end = destination+capacity;
+    size_t position = 0, anchor = 0;
+    size_t misses = 0;
+    while(count >= LZ_MATCH_LIMIT && position+LZ_MATCH_LIMIT < count){
+        uint32_t sequence = lzRead32(source+position);
+        uint32_t slot = (sequence*2654435761u) >> (32-bits);
+        size_t candidate = table[slot];
+        table[slot] = position+1;
+        if(candidate == 0 || position-(candidate-1) > LZ_MAX_OFFSET || lzRead32(source+candidate-1) != sequence){
+            position += 1+(misses++ >> 6); // skip faster through incompressible data
+            continue;
+        }
+        misses = 0;
+        size_t match = candidate-1;
+        size_t length = lzMatchLength(source+match, source+position, LZ_MIN_MATCH, count-LZ_LAST_LITERALS-position);
+
+        // Write sequence
+        size_t literals = position-anchor;
+        if((size_t)(end-cur) < 1+literals/255+1+literals+2+(length-LZ_MIN_MATCH)/255+1){
+            free(table);
+            return 0;
+        }
+        unsigned char *token = cur++;
+        *token = (literals < 15 ? literals : 15) << 4 | (length-LZ_MIN_MATCH < 15 ? length-LZ_MIN_MATCH : 15);
+        if(literals >= 15){
+            cur = lzWriteLength(cur, end, literals-15);
+        }
+        memcpy(cur, source+anchor, literals);
+        cur += literals;
+        size_t offset = position-match;
+        *cur++ = offset & 0xff;
+        *cur++ = offset >> 8;
+        if(length-LZ_MIN_MATCH >= 15){
+            cur = lzWriteLength(cur, end, length-LZ_MIN_MATCH-15);
+        }
+        position += length;
+        anchor = position;
+    }
+    free(table);
+
+    // Last sequence, literals only
+    size_t literals = count-anchor;
+    if((size_t)(end-cur) < 1+literals/255+1+literals){
+        return 0;
+    }
+    *cur++ = (literals < 15 ? literals : 15) << 4;
+    if(literals >= 15){
+        cur = lzWriteLength(cur, end, literals-15);
+    }
+    memcpy(cur, source+anchor, literals);
+    cur += literals;
+    return cur-destination;
+}
+
+long lzDecompressBlock(const unsigned char *source, size_t count, unsigned char *destination, size_t capacity){
+    /**
+     * Decompress block, rejecting any sequence that reads or writes out of bounds
+     * :param source: Compressed block
+     * :param count: Compressed bytes
+     * :param destination: Uncompressed block
+     * :param capacity: Destination bytes
+     * :return: Uncompressed bytes, -1 if the block is malformed
+     */
+    const unsigned char *cur = source, *end = source+count;
+    unsigned char *out = destination, *outEnd = destination+capacity;
+    while(cur < end){
+        unsigned token = *cur++;
+        size_t literals = token >> 4;
+        size_t length = token & 15;
+
+        // Short sequence far from the buffer ends, copied in fixed size chunks
+        if(literals < 15 && length < 15 && (size_t)(end-cur) >= LZ_WILD_COPY+2 && (size_t)(outEnd-out) >= LZ_FAST_ROOM){
+            memcpy(out, cur, LZ_WILD_COPY);
+            cur += literals;
+            out += literals;
+            size_t offset = cur[0] | cur[1] << 8;
+            if(offset >= 8 && offset <= (size_t)(out-destination)){
+                const unsigned char *match = out-offset;
+                memcpy(out, match, 8);
+                memcpy(out+8, match+8, 8);
+                memcpy(out+16, match+16, 8);
+                cur += 2;
+                out += length+LZ_MIN_MATCH;
+                continue;
+            }
+            literals = 0; // Match is checked below
+        }
+
+        // Copy literals
+        if(literals == 15){
+            unsigned char extension;
+            do{
+                if(cur == end){ // Error handling
+                    return -1;
+                }
+                extension = *cur++;
+                literals += extension;
+            }while(extension == 255);
+        }
+        if(literals > (size_t)(end-cur) || literals > (size_t)(outEnd-out)){ // Error handling
+            return -1;
+        }
+        if((size_t)(end-cur) >= literals+LZ_WILD_COPY && (size_t)(outEnd-out) >= literals+LZ_WILD_COPY){
+            lzWildCopy(out, cur, literals);
+        }else{
+            memcpy(out, cur, literals);
+        }
+        cur += literals;
+        out += literals;
+        if(cur == end){ // Last sequence
+            break;
+        }
+
+        // Copy match
+        if(end-cur < 2){ // Error handling
+            return -1;
+        }
+        size_t offset = cur[0] | cur[1] << 8;
+        cur += 2;
+        if(length == 15){
+            unsigned char extension;
+            do{
+                if(cur == end){ // Error handling
+                    return -1;
+                }
+                extension = *cur++;
+                length += extension;
+            }while(extension == 255);
+        }
+        length += LZ_MIN_MATCH;
+        if(offset == 0 || offset > (size_t)(out-destination) || length > (size_t)(outEnd-out)){ // Error handling
+            return -1;
+        }
+        const unsigned char *match = out-offset;
+        if(offset >= LZ_WILD_COPY && (size_t)(outEnd-out) >= length+LZ_WILD_COPY){
+            lzWildCopy(out, match, length);
+        }else if(offset >= length){
+            memcpy(out, match, length);
+        }else{ // Overlapping match repeats the last offset bytes
+            for(size_t i=0; i < length; i++){
+                out[i] = match[i];
+            }
+        }
+        out += length;
+    }
+    return out-destination;
+}
+
+unsigned char *lzWriteLength(unsigned char *cur, unsigned char *end, size_t length){
+    /**
+     * Write token length extension, 255 valued bytes then the remainder
+     * :param cur: Destination, room already checked by the caller
+     * :param end: Destination end
+     * :param length: Length beyond the token nibble
+     * :return: Destination after the extension
+     */
+    while(length >= 255 && cur < end){
+        *cur++ = 255;
+        length -= 255;
+    }
+    *cur++ = length;
+    return cur;
+}
+
+size_t lzMatchLength(const unsigned char *match, const unsigned char *cur, size_t length, size_t limit){
+    /**
+     * Extend match, comparing a word at a time
+     * :param match: Earlier occurrence
+     * :param cur: Current position
+     * :param length: Bytes already known to match
+     * :param limit: Longest match allowed
+     * :return: Match length
+     */
+    while(length+sizeof(uint64_t) <= limit){
+        uint64_t a, b;
+        memcpy(&a, match+length, sizeof(a));
+        memcpy(&b, cur+length, sizeof(b));
+        if(a != b){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return length+__builtin_ctzll(a ^ b)/8;
+#else
+            return length+__builtin_clzll(a ^ b)/8;
+#endif
+        }
+        length += sizeof(uint64_t);
+    }
+    while(length < limit && match[length] == cur[length]){
+        length++;
+    }
+    return length;
+}
+
+void lzWildCopy(unsigned char *destination, const unsigned char *source, size_t count){
+    /**
+     * Copy in whole LZ_WILD_COPY chunks, overrunning count by up to a chunk
+     * :param destination: Destination with LZ_WILD_COPY bytes of room past count
+     * :param source: Source with as much room, at least LZ_WILD_COPY bytes behind destination if overlapping
+     * :param count: Bytes to copy
+     * :return: None
+     */
+    for(size_t i=0; i < count; i += LZ_WILD_COPY){
+        memcpy(destination+i, source+i, LZ_WILD_COPY);
+    }
+}
+
+long lzDecompressFrame(const unsigned char *body, size_t count, unsigned char *destination, size_t capacity){
+    /**
+     * Decompress whole compressed member body held in memory
+     * The content hash is left to the caller to check
+     * :param body: Compressed member body, frame included
+     * :param count: Compressed member body bytes
+     * :param destination: Uncompressed body
+     * :param capacity: Destination bytes
+     * :return: Uncompressed bytes, -1 if the body is malformed
+     */
+    const unsigned char *cur = body+LZ_FRAME_SIZE, *end = body+count;
+    unsigned char *out = destination;
+    while(cur < end){
+        if(end-cur < LZ_BLOCK_HEADER_SIZE){ // Error handling
+            return -1;
+        }
+        uint32_t word = lzRead32(cur);
+        size_t length = word & ~LZ_STORED;
+        cur += LZ_BLOCK_HEADER_SIZE;
+        size_t room = capacity-(out-destination);
+        if(length > (size_t)(end-cur) || length > LZ_BLOCK_SIZE){ // Error handling
+            return -1;
+        }
+        long bytes = length;
+        if(word & LZ_STORED){
+            if(length > room){ // Error handling
+                return -1;
+            }
+            memcpy(out, cur, length);
+        }else{
+            bytes = lzDecompressBlock(cur, length, out, room < LZ_BLOCK_SIZE ? room : LZ_BLOCK_SIZE);
+            if(bytes < 0){ // Error handling
+                return -1;
+            }
+        }
+        cur += length;
+        out += bytes;
+    }
+    return out-destination;
+}
+
+void lzWriteFrame(unsigned char *frame, uint64_t size, uint64_t hash){
+    /**
+     * Write compressed member frame
+     * :param frame: Destination of LZ_FRAME_SIZE bytes
+     * :param size: Uncompressed bytes
+     * :param hash: Content hash of uncompressed bytes
+     * :return: None
+     */
+    memcpy(frame, LZ_MAGIC, LZ_MAGIC_SIZE);
+    lzWrite32(frame+8, size);
+    lzWrite32(frame+12, size >> 32);
+    lzWrite32(frame+16, hash);
+    lzWrite32(frame+20, hash >> 32);
+}
+
+int lzReadFrame(const unsigned char *frame, size_t count, uint64_t *size, uint64_t *hash){
+    /**
+     * Read compressed member frame
+     * :param frame: Start of member body
+     * :param count: Member body bytes available
+     * :param size: Destination of uncompressed bytes
+     * :param hash: Destination of content hash
+     * :return: Body is a compressed member
+     */
+    if(count < LZ_FRAME_SIZE || memcmp(frame, LZ_MAGIC, LZ_MAGIC_SIZE) != 0){
+        return 0;
+    }
+    *size = lzRead32(frame+8) | (uint64_t)lzRead32(frame+12) << 32;
+    *hash = lzRead32(frame+16) | (uint64_t)lzRead32(frame+20) << 32;
+    return 1;
+}
+
+void lzWrite32(unsigned char *cur, uint32_t value){
+    /**
+     * Write little endian 32-bit word
+     * :param cur: Destination
+     * :param value: Word
+     * :return: None
+     */
+    cur[0] = value;
+    cur[1] = value >> 8;
+    cur[2] = value >> 16;
+    cur[3] = value >> 24;
+}
+
+uint32_t lzRead32(const unsigned char *cur){
+    /**
+     * Read little endian 32-bit word
+     * :param cur: Source
+     * :return: Word
+     */
+    return cur[0] | cur[1] << 8 | cur[2] << 16 | (uint32_t)cur[3] << 24;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MANIFEST_ADD 0
+#define MANIFEST_REPLACE 1
+#define MANIFEST_DELETE 2
+#define MANIFEST_EXTRACT 3
+
+
+/* Batch manifest for -M: one operation per line, a keyword followed by
+   any number of operands separated by whitespace. Blank lines and lines
+   starting with '#' are ignored.
+
+       add file...        append on-disk files, like -q
+       replace file...    delete every archived file of the same name, then add
+       delete name...     delete the first archived file of each name, like -d
+       extract name...    extract the first archived file of each name, like -x */
+
+typedef struct manifestOperation{
+    int type; // MANIFEST_ADD, MANIFEST_REPLACE, MANIFEST_DELETE or MANIFEST_EXTRACT
+    char *operand; // on-disk file path or archived file name
+}manifestOperationStruct;
+
+typedef struct manifest{
+    manifestOperationStruct *operations; // in manifest order
+    size_t count;
+    size_t capacity;
+}manifestStruct;
+
+
+manifestStruct *manifestRead(char *pathname);
+void manifestFree(manifestStruct *manifest);
+int manifestOperationType(char *keyword);
+void manifestAppend(manifestStruct *manifest, int type, char *operand);
+
+
+manifestStruct *manifestRead(char *pathname){
+    /**
+     * Read batch manifest, every operation is checked before any is applied
+     * :param pathname: On-disk manifest path, "-" for standard input
+     * :return: Batch manifest
+     */
+    FILE *file = strcmp(pathname, "-") == 0 ? stdin : fopen(pathname, "r");
+    if(file == NULL){ // Error handling
+        fprintf(stderr, "Error: Cannot read only open file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    manifestStruct *manifest = malloc(sizeof(manifestStruct));
+    manifest->count = 0;
+    manifest->capacity = 16;
+    manifest->operations = malloc(manifest->capacity*sizeof(manifestOperationStruct));
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    int lineNumber = 0;
+    while(getline(&line, &lineSize, file) != -1){
+        lineNumber++;
+        char *keyword = strtok(line, " \t\r\n");
+        if(keyword == NULL || keyword[0] == '#'){ // Blank or comment
+            continue;
+        }
+        int type = manifestOperationType(keyword);
+        if(type == -1){ // Error handling
+            fprintf(stderr, "Error: Unknown operation \"%s\" on manifest line %d\n", keyword, lineNumber);
+            exit(EXIT_FAILURE);
+        }
+        char *operand;
+        while((operand = strtok(NULL, " \t\r\n")) != NULL){
+            manifestAppend(manifest, type, operand);
+        }
+    }
+    free(line);
+    if(file != stdin){
+        fclose(file);
+    }
+    return manifest;
+}
+
+void manifestFree(manifestStruct *manifest){
+    /**
+     * Free batch manifest heap memory
+     * :param manifest: Batch manifest
+     * :return: None
+     */
+    for(size_t i=0; i < manifest->count; i++){
+        free(manifest->operations[i].operand);
+    }
+    free(manifest->operations);
+    free(manifest);
+}
+
+int manifestOperationType(char *keyword){
+    /**
+     * Operation type of manifest keyword
+     * :param keyword: Manifest keyword
+     * :return: Operation type, -1 if unknown
+     */
+    if(strcmp(keyword, "add") == 0){
+        return MANIFEST_ADD;
+    }else if(strcmp(keyword, "replace") == 0){
+        return MANIFEST_REPLACE;
+    }else if(strcmp(keyword, "delete") == 0){
+        return MANIFEST_DELETE;
+    }else if(strcmp(keyword, "extract") == 0){
+        return MANIFEST_EXTRACT;
+    }
+    return -1;
+}
+
+void manifestAppend(manifestStruct *manifest, int type, char *operand){
+    /**
+     * Append operation to batch manifest
+     * :param manifest: Batch manifest
+     * :param type: Operation type
+     * :param operand: On-disk file path or archived file name, copied
+     * :return: None
+     */
+    if(manifest->count == manifest->capacity){
+        manifest->capacity *= 2;
+        manifest->operations = realloc(manifest->operations, manifest->capacity*sizeof(manifestOperationStruct));
+    }
+    manifest->operations[manifest->count].type = type;
+    manifest->operations[manifest->count].operand = strdup(operand);
+    manifest->count++;
+}
@@ -1,8 +1,17 @@
 #include "myar.h"
 
+
+#define USAGE "Error: Usage \"myar [-j jobs] [-u] [-i] [-z] [--stats[=json]] [--engine=uring|blocking] -qxtvdAswM archive-file file...\"\n"
+
+
 int main(int argc, char **argv){
+    int consumed = parseOptions(argc, argv);
+    argv[consumed] = argv[0];
+    argc -= consumed;
+    argv += consumed;
+
     if(argc < 3){ // Error handling
-        fprintf(stderr, "Error: Usage \"myar -qxtvdA archive-file file...\"\n");
+        fprintf(stderr, USAGE);
         exit(EXIT_FAILURE);
     }
 
@@ -17,9 +26,15 @@ int main(int argc, char **argv){
     }else if(shouldDelete(argv)){ // -d
         doDelete(argc, argv);
     }else if(shouldAppendAll(argv)){ // -A
-        doAppendAll(argc, argv);
+        doAppendAll(argv);
+    }else if(shouldWriteCatalog(argv)){ // -s
+        doWriteCatalog(argv);
+    }else if(shouldWatch(argv)){ // -w
+        doWatch(argc, argv);
+    }else if(shouldApplyManifest(argv)){ // -M
+        doApplyManifest(argc, argv);
     }else{
-        fprintf(stderr, "Error: Usage \"myar -qxtvdA archive-file file...\"\n");
+        fprintf(stderr, USAGE);
         exit(EXIT_FAILURE);
     }
     
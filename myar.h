@@ -1,7 +1,126 @@
-#include <ctype.h>
 #include <dirent.h>
 #include <stdbool.h>
 #include "deque.h"
+#include "engine.h"
+#include "pool.h"
+#include "classify.h"
+#include "watch.h"
+#include "manifest.h"
+
+
+#define INGEST_WINDOW_PER_JOB 8
+#define APPEND_PENDING_SIZE (64 << 20) // -q, -A and -w body bytes queued before a flush
+#define MANIFEST_PENDING_SIZE (64 << 20) // -M added file bytes queued before a flush
+
+
+typedef struct options{
+    int jobs; // -j worker threads
+    bool isUpdate; // -u replace changed archived files, skip identical ones
+    bool isCompressed; // -z compress appended files, see lz.h
+    bool isIncremental; // -i skip files unchanged since archived, see `appendChangedFiles`
+    int engine; // --engine serial extract and append I/O, see engine.h
+}optionsStruct;
+
+typedef struct append{
+    char *archive;
+    int fd; // archive open at end
+    struct stat archivedata; // archive status at open, its identity is excluded by -A and -w
+    writerStruct *writer;
+    off_t offset; // archive end past the archived files queued on the writer
+    archivedFileStruct **pending; // archived files queued since the last flush
+    size_t pendingCount;
+    size_t pendingCapacity;
+    off_t pendingSize; // body bytes held by pending
+    dequeStruct *deque; // archive headers with -u or -i, NULL otherwise
+    bool isDeleted; // -u deleted archived files await compaction
+}appendStruct;
+
+typedef struct ingest{
+    struct stat *archivedata; // archive status, see `isAppendAllFile`
+    char **pathnames;
+    archivedFileStruct **archivedFiles; // read files, NULL if skipped
+    bool *isReady; // file at position was classified and read
+    size_t count;
+    size_t written; // files handed to the archive writer
+    size_t window; // files workers may read ahead of the writer
+    bool isFiltered;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+}ingestStruct;
+
+typedef struct extract{
+    dequeStruct *deque;
+    archivedFileStruct **archivedFiles;
+    size_t count;
+}extractStruct;
+
+
+optionsStruct options = {.jobs = 1, .isUpdate = false, .isCompressed = false, .isIncremental = false, .engine = ENGINE_BLOCKING};
+
+
+int parseOptions(int argc, char **argv);
+void extractArchivedFile(void *context, size_t i);
+void appendFiles(char *archive, char **pathnames, size_t count, bool isFiltered);
+size_t appendChangedFiles(appendStruct *append, char **pathnames, size_t count, char **changed);
+appendStruct *appendOpen(char *archive);
+bool appendArchivedFile(appendStruct *append, archivedFileStruct *archivedFile);
+void appendHold(appendStruct *append, archivedFileStruct *archivedFile);
+void appendFlush(appendStruct *append);
+void appendCompact(appendStruct *append);
+void appendClose(appendStruct *append);
+void ingestFile(void *context, size_t i);
+bool isAppendAllFile(char *pathname, struct stat *archivedata);
+void appendWatchedFile(char *pathname, appendStruct *append);
+bool manifestCheckAdded(dequeStruct *deque, struct stat *archivedata, char *pathname, archivedFileStruct **loaded);
+void manifestAppendFiles(char *archive, char **pathnames, archivedFileStruct **loaded, size_t count);
+void manifestDeleteAdded(char **added, size_t addedCount, char *name, bool isAll);
+
+
+int parseOptions(int argc, char **argv){
+    /**
+     * Parse options given before the key into `options`
+     * :param argc: Command arguments count
+     * :param argv: Command arguments
+     * :return: Command arguments consumed by options
+     */
+    char *format = getenv("MYAR_STATS"); // same as --stats, "json" for --stats=json
+    if(format != NULL && format[0] != '\0' && strcmp(format, "0") != 0){
+        statsStart(strcmp(format, "json") == 0 ? STATS_JSON : STATS_TEXT);
+    }
+    char *engine = getenv("MYAR_ENGINE"); // same as --engine
+    if(engine != NULL && (strcmp(engine, "uring") == 0 || strcmp(engine, "blocking") == 0)){
+        options.engine = engine[0] == 'u' ? ENGINE_URING : ENGINE_BLOCKING;
+    }
+    int i = 1;
+    while(i < argc){
+        if(strcmp(argv[i], "-j") == 0 && i+1 < argc){ // -j jobs
+            options.jobs = atoi(argv[i+1]);
+            if(options.jobs < 1){
+                fprintf(stderr, "Error: Jobs \"%s\" must be a positive number\n", argv[i+1]);
+                exit(EXIT_FAILURE);
+            }
+            i += 2;
+        }else if(strcmp(argv[i], "-u") == 0){ // -u
+            options.isUpdate = true;
+            i++;
+        }else if(strcmp(argv[i], "-i") == 0){ // -i
+            options.isIncremental = true;
+            i++;
+        }else if(strcmp(argv[i], "-z") == 0){ // -z
+            options.isCompressed = true;
+            i++;
+        }else if(strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=json") == 0){ // --stats[=json]
+            statsStart(argv[i][7] == '=' ? STATS_JSON : STATS_TEXT);
+            i++;
+        }else if(strcmp(argv[i], "--engine=uring") == 0 || strcmp(argv[i], "--engine=blocking") == 0){ // --engine=uring|blocking
+            options.engine = argv[i][9] == 'u' ? ENGINE_URING : ENGINE_BLOCKING;
+            i++;
+        }else{
+            break;
+        }
+    }
+    return i-1;
+}
 
 
 int shouldAppend(char **argv){
@@ -21,21 +140,288 @@ void doAppend(int argc, char **argv){
      * :pararm argv: Command arguments
      * :return: None
      */
-    // Read archive
     char *archive = argv[2];
     forceOpenCloseArchive(archive);
-    dequeStruct *deque = archiveToDequeStruct(archive);
+    appendFiles(archive, argv+3, argc-3, false);
+}
 
-    // Append unarchived file(s)
-    char *file;
-    for(int i=3; i < argc; i++){
-        file = argv[i];
-        dequeStructAppendArchivedFile(deque, file);
+void appendFiles(char *archive, char **pathnames, size_t count, bool isFiltered){
+    /**
+     * Append on-disk files to end of archive in pathname order
+     * With -j workers open, classify and read files concurrently while the
+     * calling thread writes them in order. With -i files unchanged since
+     * archived are dropped first, without being opened
+     * :param archive: On-disk archive file path
+     * :param pathnames: On-disk unarchived file paths
+     * :param count: On-disk unarchived file paths count
+     * :param isFiltered: Skip files `isAppendAllFile` rejects
+     * :return: None
+     */
+    appendStruct *append = appendOpen(archive);
+    char **changed = NULL;
+    if(options.isIncremental){
+        changed = malloc((count > 0 ? count : 1)*sizeof(char *));
+        count = appendChangedFiles(append, pathnames, count, changed);
+        pathnames = changed;
     }
+    if(options.jobs <= 1){ // Append unarchived file(s) serially, read in engine batches
+        engineStruct *engine = engineOpen(options.engine);
+        char **batch = malloc(engine->batch*sizeof(char *));
+        archivedFileStruct **archivedFiles = malloc(engine->batch*sizeof(archivedFileStruct *));
+        size_t i = 0;
+        while(i < count){
+            size_t batchCount = 0;
+            for(; i < count && batchCount < engine->batch; i++){
+                if(!isFiltered || isAppendAllFile(pathnames[i], &append->archivedata)){
+                    batch[batchCount++] = pathnames[i];
+                }
+            }
+            engineIngest(engine, batch, batchCount, options.isCompressed, archivedFiles);
+            for(size_t j=0; j < batchCount; j++){
+                if(archivedFiles[j] != NULL){
+                    appendArchivedFile(append, archivedFiles[j]);
+                }
+            }
+        }
+        free(archivedFiles);
+        free(batch);
+        engineClose(engine);
+    }else{ // Append unarchived file(s) read by workers
+        ingestStruct ingest = {.archivedata = &append->archivedata, .pathnames = pathnames, .count = count, .written = 0, .isFiltered = isFiltered};
+        ingest.archivedFiles = calloc(count, sizeof(archivedFileStruct *));
+        ingest.isReady = calloc(count, sizeof(bool));
+        ingest.window = options.jobs*INGEST_WINDOW_PER_JOB;
+        pthread_mutex_init(&ingest.lock, NULL);
+        pthread_cond_init(&ingest.changed, NULL);
+        poolStruct *pool = poolStart(options.jobs, count, ingestFile, &ingest);
 
-    // Overwrite archive
-    dequeStructToArchive(deque, archive);
-    dequeFree(deque);
+        for(size_t i=0; i < count; i++){
+            pthread_mutex_lock(&ingest.lock);
+            while(!ingest.isReady[i]){
+                pthread_cond_wait(&ingest.changed, &ingest.lock);
+            }
+            pthread_mutex_unlock(&ingest.lock);
+
+            if(ingest.archivedFiles[i] != NULL){
+                appendArchivedFile(append, ingest.archivedFiles[i]);
+            }
+
+            pthread_mutex_lock(&ingest.lock);
+            ingest.written = i+1;
+            pthread_cond_broadcast(&ingest.changed);
+            pthread_mutex_unlock(&ingest.lock);
+        }
+
+        poolJoin(pool);
+        pthread_cond_destroy(&ingest.changed);
+        pthread_mutex_destroy(&ingest.lock);
+        free(ingest.isReady);
+        free(ingest.archivedFiles);
+    }
+    free(changed);
+    appendClose(append);
+}
+
+size_t appendChangedFiles(appendStruct *append, char **pathnames, size_t count, char **changed){
+    /**
+     * Collect on-disk files that are new or changed since archived
+     * A regular file is unchanged when an archived file of its name has its
+     * size and modification time, which takes one stat and no reads. Files
+     * modified in the same second the archive was last written or later
+     * could have changed since without their time changing, so they are
+     * kept to be read
+     * :param append: Archive appender with archive headers
+     * :param pathnames: On-disk unarchived file paths
+     * :param count: On-disk unarchived file paths count
+     * :param changed: Destination of at least count file paths
+     * :return: Changed file paths count
+     */
+    struct stat *archivedata = &append->archivedata;
+    size_t changedCount = 0;
+    for(size_t i=0; i < count; i++){
+        struct stat filedata;
+        if(stat(pathnames[i], &filedata) == 0 && S_ISREG(filedata.st_mode) && filedata.st_mtime < archivedata->st_mtime &&
+                dequeStructHasUnchangedFile(append->deque, basename(pathnames[i]), &filedata)){
+            continue;
+        }
+        changed[changedCount++] = pathnames[i];
+    }
+    return changedCount;
+}
+
+appendStruct *appendOpen(char *archive){
+    /**
+     * Open archive for appending archived files at its end
+     * With -u or -i the archive headers are read for `appendArchivedFile`
+     * and `appendChangedFiles`
+     * :param archive: On-disk archive file path
+     * :return: Archive appender
+     */
+    appendStruct *append = malloc(sizeof(appendStruct));
+    append->archive = archive;
+    append->fd = openArchiveAppend(archive);
+    append->writer = writerOpen(append->fd, archive);
+    fstat(append->fd, &append->archivedata);
+    append->offset = append->archivedata.st_size;
+    append->pendingCount = 0;
+    append->pendingCapacity = 0;
+    append->pendingSize = 0;
+    append->pending = NULL;
+    append->deque = NULL;
+    append->isDeleted = false;
+    if(options.isUpdate || options.isIncremental){
+        append->deque = archiveToCatalogDequeStruct(archive);
+        if(append->deque == NULL){
+            append->deque = archiveToHeaderDequeStruct(archive);
+            append->deque->fd = openFileReadOnly(archive);
+        }
+    }
+    statsPhase(STATS_MUTATE);
+    return append;
+}
+
+bool appendArchivedFile(appendStruct *append, archivedFileStruct *archivedFile){
+    /**
+     * Queue archived file at end of archive, taking ownership of it
+     * With -u it is skipped if an identical archived file of the same name
+     * exists, otherwise older copies are deleted at the next `appendCompact`.
+     * Its content hash is taken before it is queued, so later comparisons
+     * never read the unflushed end of the archive
+     * :param append: Archive appender
+     * :param archivedFile: Unarchived file structured data
+     * :return: Archived file was appended
+     */
+    dequeStruct *deque = options.isUpdate ? append->deque : NULL;
+    if(deque != NULL && dequeStructHasArchivedFile(deque, archivedFile)){
+        archivedFileFree(archivedFile);
+        return false;
+    }
+    if(deque != NULL){
+        archivedFileHash(deque, archivedFile);
+    }
+    statsPhase(STATS_WRITE);
+    off_t offset = append->offset;
+    archivedFileStructToArchive(archivedFile, append->writer);
+    append->offset += sizeof(archivedFileHeaderStruct)+archivedFile->size+archivedFile->size%2;
+    statsPhase(STATS_MUTATE);
+    if(deque == NULL){
+        appendHold(append, archivedFile);
+        return true;
+    }
+
+    // Replace older copies, keeping the header and content hash
+    while(nameIndexFind(deque->index, archivedFile->name) != NULL){
+        dequeStructDeleteArchivedFile(deque, archivedFile->name);
+        append->isDeleted = true;
+    }
+    archivedFileHeaderStruct *header = arenaAlloc(deque->arena, sizeof(archivedFileHeaderStruct));
+    memcpy(header, archivedFile->header, sizeof(archivedFileHeaderStruct));
+    archivedFileStruct *archived = dequeAppendRear(deque, header, offset);
+    archived->length = append->offset-offset;
+    archived->isHashed = archivedFile->isHashed;
+    archived->hash = archivedFile->hash;
+    appendHold(append, archivedFile);
+    return true;
+}
+
+void appendHold(appendStruct *append, archivedFileStruct *archivedFile){
+    /**
+     * Keep queued archived file until the writer is flushed
+     * The writer references large bodies in place, so they are freed only
+     * after the flush, forced once APPEND_PENDING_SIZE body bytes are held.
+     * A streamed body was already copied through the writer
+     * :param append: Archive appender
+     * :param archivedFile: Archived file queued on the writer
+     * :return: None
+     */
+    if(archivedFile->body == NULL){
+        archivedFileFree(archivedFile);
+        return;
+    }
+    if(append->pendingCount == append->pendingCapacity){
+        append->pendingCapacity = append->pendingCapacity > 0 ? append->pendingCapacity*2 : DEQUE_INITIAL_CAPACITY;
+        append->pending = realloc(append->pending, append->pendingCapacity*sizeof(archivedFileStruct *));
+    }
+    append->pending[append->pendingCount++] = archivedFile;
+    append->pendingSize += archivedFile->size;
+    if(append->pendingSize >= APPEND_PENDING_SIZE){
+        appendFlush(append);
+    }
+}
+
+void appendFlush(appendStruct *append){
+    /**
+     * Write queued archived files to the archive and free them
+     * :param append: Archive appender
+     * :return: None
+     */
+    statsPhase(STATS_WRITE);
+    writerFlush(append->writer);
+    statsPhase(STATS_MUTATE);
+    for(size_t i=0; i < append->pendingCount; i++){
+        archivedFileFree(append->pending[i]);
+    }
+    append->pendingCount = 0;
+    append->pendingSize = 0;
+}
+
+void appendCompact(appendStruct *append){
+    /**
+     * Flush queued archived files, then remove archived files replaced under
+     * -u and save cached content hashes to the catalog member, if any
+     * :param append: Archive appender
+     * :return: None
+     */
+    appendFlush(append);
+    dequeStruct *deque = options.isUpdate ? append->deque : NULL;
+    if(deque != NULL && (append->isDeleted || deque->catalog != NULL)){
+        dequeStructCompactArchive(deque, append->archive);
+        append->offset = lseek(append->fd, 0, SEEK_END);
+        append->isDeleted = false;
+    }
+}
+
+void appendClose(appendStruct *append){
+    /**
+     * Compact archive and free archive appender heap memory
+     * :param append: Archive appender
+     * :return: None
+     */
+    appendCompact(append);
+    writerClose(append->writer);
+    close(append->fd);
+    if(append->deque != NULL){
+        dequeFree(append->deque);
+    }
+    free(append->pending);
+    free(append);
+}
+
+void ingestFile(void *context, size_t i){
+    /**
+     * Classify and read one on-disk file for the ordered archive writer
+     * Worker task of `appendFiles`, waits while too far ahead of the writer
+     * :param context: Ingest state
+     * :param i: On-disk unarchived file position
+     * :return: None
+     */
+    ingestStruct *ingest = context;
+    pthread_mutex_lock(&ingest->lock);
+    while(i >= ingest->written+ingest->window){
+        pthread_cond_wait(&ingest->changed, &ingest->lock);
+    }
+    pthread_mutex_unlock(&ingest->lock);
+
+    archivedFileStruct *archivedFile = NULL;
+    if(!ingest->isFiltered || isAppendAllFile(ingest->pathnames[i], ingest->archivedata)){
+        archivedFile = fileToArchivedFileStruct(ingest->pathnames[i], options.isCompressed);
+    }
+
+    pthread_mutex_lock(&ingest->lock);
+    ingest->archivedFiles[i] = archivedFile;
+    ingest->isReady[i] = true;
+    pthread_cond_broadcast(&ingest->changed);
+    pthread_mutex_unlock(&ingest->lock);
 }
 
 int shouldExtract(char **argv){
@@ -51,36 +437,75 @@ int shouldExtract(char **argv){
 void doExtract(int argc, char **argv){
     /**
      * Extract archived files to on-disk
+     * The first archived file of each name is extracted, across -j workers
+     * Bodies are streamed from the archive, so memory stays bounded
      * :param argc: Command arguments count
      * :param argv: Command arguments
      * :return: None
      */
     char *archive = argv[2];
-    dequeStruct *deque = archiveToDequeStruct(archive);
+    dequeStruct *deque = NULL;
+    if(argc > 3){ // Look named archived files up in the catalog
+        deque = archiveToCatalogNamesDequeStruct(archive, argv+3, argc-3);
+    }else{
+        deque = archiveToCatalogDequeStruct(archive);
+    }
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+        deque->fd = openFileReadOnly(archive);
+    }
+
+    // Collect first archived file of each name
+    extractStruct extract = {.deque = deque, .count = 0};
     if(argc > 3){ // Extract filtered archive
+        extract.archivedFiles = malloc((argc-3)*sizeof(archivedFileStruct *));
+        nameIndexStruct *queued = nameIndexCreate(NULL);
         char *file;
         for(int i=3; i < argc; i++){
             file = argv[i];
-            dequeNodeStruct *cur = deque->front->next;
-            while(cur->next != NULL){
-                archivedFileStruct *archivedFile = cur->data;
-                if(strncmp(archivedFile->header->ar_name, file, strlen(file)) == 0){
-                    archivedFileStructToFile(archivedFile);
-                }
-                cur = cur->next;
+            nameIndexEntryStruct *entry = nameIndexFind(deque->index, file);
+            if(entry != NULL && nameIndexFind(queued, file) == NULL){
+                nameIndexInsert(queued, file, entry->position);
+                extract.archivedFiles[extract.count++] = &deque->members[entry->position];
             }
         }
+        nameIndexFree(queued);
     }else{ // Extract unfiltered archive
-        dequeNodeStruct *cur = deque->front->next;
-        while(cur->next != NULL){
-            archivedFileStruct *archivedFile = cur->data;
-            archivedFileStructToFile(archivedFile);
-            cur = cur->next;
+        extract.archivedFiles = malloc(deque->index->entryCount*sizeof(archivedFileStruct *));
+        for(size_t i=0; i < deque->count; i++){
+            archivedFileStruct *archivedFile = &deque->members[i];
+            if(nameIndexFind(deque->index, archivedFile->name)->position == i){
+                extract.archivedFiles[extract.count++] = archivedFile;
+            }
         }
     }
+
+    // Extract archived file(s)
+    statsPhase(STATS_WRITE);
+    if(options.jobs <= 1){ // Serially through the I/O engine
+        engineStruct *engine = engineOpen(options.engine);
+        engineExtract(engine, deque, extract.archivedFiles, extract.count);
+        engineClose(engine);
+    }else{
+        poolRun(options.jobs, extract.count, extractArchivedFile, &extract);
+    }
+    free(extract.archivedFiles);
     dequeFree(deque);
 }
 
+void extractArchivedFile(void *context, size_t i){
+    /**
+     * Extract one collected archived file to on-disk
+     * Worker task of `doExtract`
+     * :param context: Extract collection
+     * :param i: Collected archived file position
+     * :return: None
+     */
+    extractStruct *extract = context;
+    archivedFileStruct *archivedFile = extract->archivedFiles[i];
+    archivedFileStructToFile(extract->deque, archivedFile);
+}
+
 int shouldPrintConciseTable(char **argv){
     /**
      * Should print concise table of archive
@@ -99,7 +524,19 @@ void doPrintConciseTable(int argc, char **argv){
      * :return: None
      */
     char *archive = argv[2];
-    dequeStruct *deque = archiveToDequeStruct(archive);
+    dequeStruct *deque = NULL;
+    if(argc > 3){ // Look named archived files up in the catalog
+        deque = archiveToCatalogNamesDequeStruct(archive, argv+3, argc-3);
+    }else{
+        deque = archiveToCatalogDequeStruct(archive);
+    }
+    if(deque == NULL){
+        deque = archiveToMappedDequeStruct(archive, MADV_RANDOM);
+    }
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+    }
+    statsPhase(STATS_WRITE);
     if(argc > 3){ // Print filtered concise table
         char *file;
         for(int i=3; i < argc; i++){
@@ -130,26 +567,32 @@ void doPrintVerboseTable(int argc, char **argv){
      * :return: None
      */
     char *archive = argv[2];
-    dequeStruct *deque = archiveToDequeStruct(archive);
+    dequeStruct *deque = NULL;
+    if(argc > 3){ // Look named archived files up in the catalog
+        deque = archiveToCatalogNamesDequeStruct(archive, argv+3, argc-3);
+    }else{
+        deque = archiveToCatalogDequeStruct(archive);
+    }
+    if(deque == NULL){
+        deque = archiveToMappedDequeStruct(archive, MADV_RANDOM);
+    }
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+    }
+    statsPhase(STATS_WRITE);
     if(argc > 3){ // Print verbose table filtered archive
         char *file;
         for(int i=3; i < argc; i++){
             file = argv[i];
-            dequeNodeStruct *cur = deque->front->next;
-            while(cur->next != NULL){
-                archivedFileStruct *archivedFile = cur->data;
-                if(strncmp(archivedFile->header->ar_name, file, strlen(file)) == 0){
-                    archivedFileStructPrintVerbose(archivedFile);
-                }
-                cur = cur->next;
+            nameIndexEntryStruct *entry = nameIndexFind(deque->index, file);
+            while(entry != NULL){
+                archivedFileStructPrintVerbose(&deque->members[entry->position]);
+                entry = nameIndexFindNext(entry);
             }
         }
     }else{ // Print verbose table unfiltered archive
-        dequeNodeStruct *cur = deque->front->next;
-        while(cur->next != NULL){
-            archivedFileStruct *archivedFile = cur->data;
-            archivedFileStructPrintVerbose(archivedFile);
-            cur = cur->next;
+        for(size_t i=0; i < deque->count; i++){
+            archivedFileStructPrintVerbose(&deque->members[i]);
         }
     }
     dequeFree(deque);
@@ -168,13 +611,19 @@ int shouldDelete(char **argv){
 void doDelete(int argc, char **argv){
     /**
      * Delete file(s) from archive
+     * Headers come from the catalog when it is current, so the content
+     * hashes it holds are kept in the rewritten catalog
      * :param argc: Command arguments count
      * :param argv: Command arguments
      * :return: Delete file(s) from archive
      */
-    // Read archive
+    // Read archive headers
     char *archive = argv[2];
-    dequeStruct *deque = archiveToDequeStruct(archive);
+    dequeStruct *deque = archiveToCatalogDequeStruct(archive);
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+        deque->fd = openFileReadOnly(archive);
+    }
 
     // Delete archived file(s)
     char *file;
@@ -183,8 +632,37 @@ void doDelete(int argc, char **argv){
         dequeStructDeleteArchivedFile(deque, file);
     }
 
-    // Overwrite archive
-    dequeStructToArchive(deque, archive);
+    // Compact archive over deleted archived file(s)
+    dequeStructCompactArchive(deque, archive);
+    dequeFree(deque);
+}
+
+int shouldWriteCatalog(char **argv){
+    /**
+     * Should write catalog member to archive
+     * :param argv: Command arguments
+     * :return: Should write catalog member to archive
+     */
+    char *option = argv[1];
+    return strcmp(option, "-s") == 0;
+}
+
+void doWriteCatalog(char **argv){
+    /**
+     * Write catalog member to front of archive
+     * :param argv: Command arguments
+     * :return: None
+     */
+    // Read archive headers
+    char *archive = argv[2];
+    dequeStruct *deque = archiveToCatalogDequeStruct(archive);
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+        deque->fd = openFileReadOnly(archive);
+    }
+
+    // Replace archive with one led by a fresh catalog
+    dequeStructToArchive(deque, archive, 1);
     dequeFree(deque);
 }
 
@@ -198,55 +676,378 @@ int shouldAppendAll(char **argv){
     return strcmp(option, "-A") == 0;
 }
 
-void doAppendAll(int argc, char **argv){
+void doAppendAll(char **argv){
     /**
      * Append all regular files in current directory
-     * :param argc: Command arguments count
      * :param argv: Command arguments
      * :return: None
      */
-    // Read archive
     char *archive = argv[2];
-    dequeStruct *deque = archiveToDequeStruct(archive);
 
     // Read current directory
+    size_t count = 0;
+    size_t capacity = 64;
+    char **pathnames = malloc(capacity*sizeof(char *));
     DIR *curdir = opendir(".");
     struct dirent *file;
     while((file = readdir(curdir)) != NULL){
-        // Current file is a text file
-        char *buffer;
-        struct stat filedata;
-        stat(file->d_name, &filedata);
-        int fd = open(file->d_name, O_RDONLY, 0666);
-        lseek(fd, 0, SEEK_SET);
-        buffer = malloc(filedata.st_size*sizeof(char));
-        memset(buffer, '\0', filedata.st_size*sizeof(char));
-        read(fd, buffer, filedata.st_size*sizeof(char));
-        bool isTextFile = true;
-        for(int i=0; i < filedata.st_size; i++){
-            if(!isalnum(buffer[i]) && !isspace(buffer[i]) && !ispunct(buffer[i])){
-                isTextFile = false;
-            }
+        if(file->d_type != DT_REG && file->d_type != DT_LNK && file->d_type != DT_UNKNOWN){ // Skip without opening
+            continue;
         }
-        free(buffer);
+        if(count == capacity){
+            capacity *= 2;
+            pathnames = realloc(pathnames, capacity*sizeof(char *));
+        }
+        pathnames[count++] = strdup(file->d_name);
+    }
+    closedir(curdir);
 
-        // Current file is an (different) archive file
-        lseek(fd, 0, SEEK_SET);
-        buffer = malloc(SARMAG*sizeof(char));
-        memset(buffer, '\0', SARMAG*sizeof(char));
-        read(fd, buffer, SARMAG*sizeof(char));
-        bool isArchiveFile = strncmp(buffer, ARMAG, strlen(ARMAG)) == 0;
-        bool isDiffArchiveFile = isArchiveFile && strncmp(archive, file->d_name, strlen(file->d_name)) != 0;
+    // Append text and other archive files
+    appendFiles(archive, pathnames, count, true);
+    for(size_t i=0; i < count; i++){
+        free(pathnames[i]);
+    }
+    free(pathnames);
+}
+
+bool isAppendAllFile(char *pathname, struct stat *archivedata){
+    /**
+     * On-disk file should be appended by -A
+     * Regular text files and archive files other than the archive itself
+     * qualify. The archive is recognized by device and inode, whatever path
+     * names it, and is rejected without being opened
+     * :param pathname: On-disk file path
+     * :param archivedata: Archive status
+     * :return: Should append
+     */
+    struct stat filedata;
+    if(stat(pathname, &filedata) == -1 || !S_ISREG(filedata.st_mode)){
+        return false;
+    }
+    if(filedata.st_dev == archivedata->st_dev && filedata.st_ino == archivedata->st_ino){ // Archive itself
+        return false;
+    }
+    int fd = open(pathname, O_RDONLY);
+    if(fd == -1){
+        return false;
+    }
+
+    // Current file is a different archive file
+    char magic[SARMAG];
+    bool isArchiveFile = pread(fd, magic, SARMAG, 0) == SARMAG && memcmp(magic, ARMAG, SARMAG) == 0;
+    if(isArchiveFile){
         close(fd);
-        free(buffer);
+        return true;
+    }
 
-        // Archive structured data deque append on-disk file
-        if((isTextFile && !isArchiveFile) || isDiffArchiveFile){
-            dequeStructAppendArchivedFile(deque, file->d_name);
+    // Current file is a text file
+    bool isTextFile = classifyIsTextFile(fd);
+    close(fd);
+    return isTextFile;
+}
+
+int shouldWatch(char **argv){
+    /**
+     * Should append modified files in current directory until timeout
+     * :param argv: Command arguments
+     * :return: Should append modified files in current directory
+     */
+    char *option = argv[1];
+    return strcmp(option, "-w") == 0;
+}
+
+void doWatch(int argc, char **argv){
+    /**
+     * Append files modified in current directory until timeout expires
+     * Modifications are debounced so rapid writes append one copy
+     * :param argc: Command arguments count
+     * :param argv: Command arguments
+     * :return: None
+     */
+    char *archive = argv[2];
+    char *end = NULL;
+    long timeout = argc > 3 ? strtol(argv[3], &end, 10) : -1;
+    if(timeout < 0 || end == argv[3] || *end != '\0'){ // Error handling
+        fprintf(stderr, "Error: Usage \"myar -w archive-file timeout\"\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Open archive at end and watch current directory, except the archive
+    appendStruct *append = appendOpen(archive);
+    watchStruct *watch = watchOpen(".");
+    struct stat filedata;
+    char *name = basename(archive);
+    if(stat(name, &filedata) == 0 && filedata.st_dev == append->archivedata.st_dev && filedata.st_ino == append->archivedata.st_ino){
+        watchIgnore(watch, name);
+    }
+
+    // Append modified files once they settle
+    char *pathname;
+    long now = watchNow();
+    long stop = now+timeout*1000;
+    while(now < stop){
+        watchWait(watch, watchTimeout(watch, now, stop));
+        now = watchNow();
+        while((pathname = watchTakeDue(watch, now)) != NULL){
+            appendWatchedFile(pathname, append);
+            free(pathname);
         }
+        appendCompact(append);
+    }
+
+    // Append files still settling at timeout
+    while((pathname = watchTakeDue(watch, LONG_MAX)) != NULL){
+        appendWatchedFile(pathname, append);
+        free(pathname);
     }
 
-    // Overwrite archive
-    dequeStructToArchive(deque, archive);
+    watchClose(watch);
+    appendClose(append);
+}
+
+void appendWatchedFile(char *pathname, appendStruct *append){
+    /**
+     * Append modified on-disk file to end of archive and report it
+     * The archive itself is rejected by `isAppendAllFile` under any name
+     * :param pathname: On-disk unarchived file path
+     * :param append: Archive appender
+     * :return: None
+     */
+    if(!isAppendAllFile(pathname, &append->archivedata)){
+        return;
+    }
+    if(appendArchivedFile(append, fileToArchivedFileStruct(pathname, options.isCompressed))){
+        printf("Appended \"%s\"\n", pathname);
+        fflush(stdout);
+    }
+}
+
+int shouldApplyManifest(char **argv){
+    /**
+     * Should apply batch manifest to archive
+     * :param argv: Command arguments
+     * :return: Should apply batch manifest
+     */
+    char *option = argv[1];
+    return strcmp(option, "-M") == 0;
+}
+
+void doApplyManifest(int argc, char **argv){
+    /**
+     * Apply batch manifest operations to archive in one pass
+     * The archive headers are read once and every operation is resolved
+     * and checked in manifest order before anything is written. Extracts
+     * then run as their own phase, deleted archived files are compacted out
+     * in place and added files are appended through one writer
+     * :param argc: Command arguments count
+     * :param argv: Command arguments
+     * :return: None
+     */
+    if(argc != 4){ // Error handling
+        fprintf(stderr, "Error: Usage \"myar -M archive-file manifest\"\n");
+        exit(EXIT_FAILURE);
+    }
+    char *archive = argv[2];
+    manifestStruct *manifest = manifestRead(argv[3]);
+
+    // Read archive headers
+    forceOpenCloseArchive(archive);
+    dequeStruct *deque = archiveToCatalogDequeStruct(archive);
+    if(deque == NULL){
+        deque = archiveToHeaderDequeStruct(archive);
+        deque->fd = openFileReadOnly(archive);
+    }
+    struct stat archivedata;
+    fstat(deque->fd, &archivedata);
+    statsPhase(STATS_MUTATE);
+
+    // Resolve operations, archived files come before files added since
+    size_t capacity = manifest->count > 0 ? manifest->count : 1;
+    char **added = malloc(capacity*sizeof(char *));
+    archivedFileStruct **loaded = malloc(capacity*sizeof(archivedFileStruct *)); // added files read by -u
+    archivedFileStruct **extracts = malloc(capacity*sizeof(archivedFileStruct *));
+    nameIndexStruct *extracted = nameIndexCreate(NULL); // extract position by name
+    size_t addedCount = 0;
+    size_t extractCount = 0;
+    for(size_t i=0; i < manifest->count; i++){
+        char *operand = manifest->operations[i].operand;
+        nameIndexEntryStruct *entry;
+        archivedFileStruct *archivedFile;
+        switch(manifest->operations[i].type){
+            case MANIFEST_REPLACE:
+                while(nameIndexFind(deque->index, basename(operand)) != NULL){
+                    dequeStructDeleteArchivedFile(deque, basename(operand));
+                }
+                manifestDeleteAdded(added, addedCount, basename(operand), true);
+                // fall through
+            case MANIFEST_ADD:
+                if(manifestCheckAdded(deque, &archivedata, operand, &loaded[addedCount])){
+                    added[addedCount++] = operand;
+                }
+                break;
+            case MANIFEST_DELETE:
+                if(nameIndexFind(deque->index, operand) != NULL){
+                    dequeStructDeleteArchivedFile(deque, operand);
+                }else{
+                    manifestDeleteAdded(added, addedCount, operand, false);
+                }
+                break;
+            case MANIFEST_EXTRACT:
+                entry = nameIndexFind(deque->index, operand);
+                archivedFile = entry != NULL ? &deque->members[entry->position] : NULL;
+                for(size_t j=0; archivedFile == NULL && j < addedCount; j++){
+                    if(added[j] != NULL && strcmp(basename(added[j]), operand) == 0){ // Not written yet
+                        archivedFile = fileToArchivedFileStruct(added[j], false);
+                    }
+                }
+                if(archivedFile == NULL){
+                    break;
+                }
+                entry = nameIndexFind(extracted, operand);
+                if(entry == NULL){
+                    nameIndexInsert(extracted, operand, extractCount);
+                    extracts[extractCount++] = archivedFile;
+                }else{ // Extracted again, the later one is left on-disk
+                    if(extracts[entry->position]->offset == -1){
+                        archivedFileFree(extracts[entry->position]);
+                    }
+                    extracts[entry->position] = archivedFile;
+                }
+                break;
+        }
+    }
+    nameIndexFree(extracted);
+
+    // Drop added files deleted again later in the manifest
+    size_t count = 0;
+    for(size_t i=0; i < addedCount; i++){
+        if(added[i] != NULL){
+            added[count] = added[i];
+            loaded[count++] = loaded[i];
+        }else if(loaded[i] != NULL){
+            archivedFileFree(loaded[i]);
+        }
+    }
+
+    // Extract archived and added files before the archive changes
+    statsPhase(STATS_WRITE);
+    engineStruct *engine = engineOpen(options.engine);
+    engineExtract(engine, deque, extracts, extractCount);
+    engineClose(engine);
+    for(size_t i=0; i < extractCount; i++){
+        if(extracts[i]->offset == -1){ // Read from an added file
+            archivedFileFree(extracts[i]);
+        }
+    }
+    free(extracts);
+
+    // Compact archive over deleted archived file(s), saving -u content hashes to the catalog
+    if(deque->deletedCount > 0 || (options.isUpdate && deque->catalog != NULL)){
+        dequeStructCompactArchive(deque, archive);
+    }
     dequeFree(deque);
+
+    // Append added file(s)
+    manifestAppendFiles(archive, added, loaded, count);
+    free(loaded);
+    free(added);
+    manifestFree(manifest);
+}
+
+bool manifestCheckAdded(dequeStruct *deque, struct stat *archivedata, char *pathname, archivedFileStruct **loaded){
+    /**
+     * Check a file added by the manifest before the archive changes
+     * The file must be readable and its name must fit the header. With -i
+     * a file unchanged since archived is skipped by its stat alone, and with
+     * -u it is read now, to be skipped when an identical archived file
+     * exists or otherwise to delete the older copies
+     * :param deque: Archive structured data deque with open archive
+     * :param archivedata: Archive status
+     * :param pathname: On-disk unarchived file path
+     * :param loaded: Destination of the file read by -u, NULL if not read
+     * :return: File should be appended
+     */
+    *loaded = NULL;
+    char *name = basename(pathname);
+    if(strlen(name) >= AR_NAME_SIZE){ // Error handling
+        fprintf(stderr, "Error: Pathname \"%s\" character limit \"%d\"\n", pathname, AR_NAME_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    struct stat filedata;
+    int fd = openFileReadOnly(pathname);
+    fstat(fd, &filedata);
+    close(fd);
+    if(options.isIncremental && S_ISREG(filedata.st_mode) && filedata.st_mtime < archivedata->st_mtime &&
+            dequeStructHasUnchangedFile(deque, name, &filedata)){
+        return false;
+    }
+    if(!options.isUpdate){
+        return true;
+    }
+    archivedFileStruct *archivedFile = fileToArchivedFileStruct(pathname, options.isCompressed);
+    if(dequeStructHasArchivedFile(deque, archivedFile)){
+        archivedFileFree(archivedFile);
+        return false;
+    }
+    while(nameIndexFind(deque->index, name) != NULL){
+        dequeStructDeleteArchivedFile(deque, name);
+    }
+    *loaded = archivedFile;
+    return true;
+}
+
+void manifestAppendFiles(char *archive, char **pathnames, archivedFileStruct **loaded, size_t count){
+    /**
+     * Append files added by the manifest through one archive writer
+     * Files are queued in order and flushed once MANIFEST_PENDING_SIZE body
+     * bytes are held or at the end, then freed
+     * :param archive: On-disk archive file path
+     * :param pathnames: On-disk unarchived file paths
+     * :param loaded: Files already read by -u, NULL where not read
+     * :param count: On-disk unarchived file paths count
+     * :return: None
+     */
+    int fd = openArchiveAppend(archive);
+    writerStruct *writer = writerOpen(fd, archive);
+    size_t flushed = 0; // files written and freed
+    off_t pending = 0; // body bytes queued since
+    for(size_t i=0; i < count; i++){
+        if(loaded[i] == NULL){
+            loaded[i] = fileToArchivedFileStruct(pathnames[i], options.isCompressed);
+        }
+        archivedFileStructToArchive(loaded[i], writer);
+        pending += loaded[i]->size;
+        if(pending >= MANIFEST_PENDING_SIZE){ // Bound memory held for the writer
+            writerFlush(writer);
+            for(; flushed <= i; flushed++){
+                archivedFileFree(loaded[flushed]);
+            }
+            pending = 0;
+        }
+    }
+    writerClose(writer);
+    for(; flushed < count; flushed++){
+        archivedFileFree(loaded[flushed]);
+    }
+    close(fd);
+}
+
+void manifestDeleteAdded(char **added, size_t addedCount, char *name, bool isAll){
+    /**
+     * Drop files added earlier in the manifest by archived file name
+     * Dropped files are left NULL
+     * :param added: On-disk file paths added so far
+     * :param addedCount: On-disk file paths count
+     * :param name: Archived file name
+     * :param isAll: Drop every match, otherwise the first
+     * :return: None
+     */
+    for(size_t i=0; i < addedCount; i++){
+        if(added[i] != NULL && strcmp(basename(added[i]), name) == 0){
+            added[i] = NULL;
+            if(!isAll){
+                return;
+            }
+        }
+    }
 }
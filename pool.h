@@ -0,0 +1,100 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define POOL_MAX_JOBS 256
+
+
+typedef struct pool{
+    void (*task)(void *context, size_t i);
+    void *context;
+    size_t count;
+    atomic_size_t next; // next task position to claim
+    int jobs;
+    pthread_t threads[POOL_MAX_JOBS];
+}poolStruct;
+
+
+void poolRun(int jobs, size_t count, void (*task)(void *context, size_t i), void *context);
+poolStruct *poolStart(int jobs, size_t count, void (*task)(void *context, size_t i), void *context);
+void poolJoin(poolStruct *pool);
+void *poolWorker(void *argument);
+
+
+void poolRun(int jobs, size_t count, void (*task)(void *context, size_t i), void *context){
+    /**
+     * Run task for every position in [0, count) across worker threads
+     * Workers claim positions in order, so with one job tasks run serially
+     * :param jobs: Worker thread count
+     * :param count: Task position count
+     * :param task: Task function called with context and position
+     * :param context: Task context shared by all workers
+     * :return: None
+     */
+    if(jobs <= 1 || count <= 1){
+        poolStruct pool = {.task = task, .context = context, .count = count};
+        atomic_init(&pool.next, 0);
+        poolWorker(&pool);
+        return;
+    }
+    poolJoin(poolStart(jobs, count, task, context));
+}
+
+poolStruct *poolStart(int jobs, size_t count, void (*task)(void *context, size_t i), void *context){
+    /**
+     * Start worker threads running task for every position in [0, count)
+     * The calling thread is free until `poolJoin`
+     * :param jobs: Worker thread count
+     * :param count: Task position count
+     * :param task: Task function called with context and position
+     * :param context: Task context shared by all workers
+     * :return: Pool
+     */
+    poolStruct *pool = malloc(sizeof(poolStruct));
+    pool->task = task;
+    pool->context = context;
+    pool->count = count;
+    atomic_init(&pool->next, 0);
+    if(jobs > POOL_MAX_JOBS){
+        jobs = POOL_MAX_JOBS;
+    }
+    if(jobs < 1){
+        jobs = 1;
+    }
+    pool->jobs = jobs;
+    for(int i=0; i < jobs; i++){
+        if(pthread_create(&pool->threads[i], NULL, poolWorker, pool) != 0){
+            fprintf(stderr, "Error: Cannot create worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void poolJoin(poolStruct *pool){
+    /**
+     * Wait for worker threads to finish and free the pool
+     * :param pool: Pool
+     * :return: None
+     */
+    for(int i=0; i < pool->jobs; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool);
+}
+
+void *poolWorker(void *argument){
+    /**
+     * Claim and run tasks until none remain
+     * :param argument: Pool
+     * :return: NULL
+     */
+    poolStruct *pool = argument;
+    size_t i;
+    while((i = atomic_fetch_add(&pool->next, 1)) < pool->count){
+        pool->task(pool->context, i);
+    }
+    return NULL;
+}
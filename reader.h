@@ -0,0 +1,171 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define READER_BLOCK_SIZE (1 << 20)
+#define READER_BLOCK_ALIGN 4096 // also the first fill after a seek, see `readerSkip`
+
+
+typedef struct reader{
+    int fd;
+    char *buffer;
+    size_t start; // next unread byte in buffer
+    size_t end; // bytes valid in buffer
+    off_t offset; // on-disk file offset of buffer[0]
+    off_t size; // on-disk file size
+    size_t window; // bytes the next fill reads, doubled back up to READER_BLOCK_SIZE after a seek
+}readerStruct;
+
+
+readerStruct *readerOpen(char *pathname);
+void readerClose(readerStruct *reader);
+int readerFill(readerStruct *reader);
+size_t readerRead(readerStruct *reader, void *destination, size_t count);
+void readerSkip(readerStruct *reader, off_t count);
+int readerPeek(readerStruct *reader);
+off_t readerOffset(readerStruct *reader);
+
+
+readerStruct *readerOpen(char *pathname){
+    /**
+     * Open on-disk file for buffered sequential block reads
+     * :param pathname: On-disk file path
+     * :return: Buffered reader
+     */
+    int fd = openFileReadOnly(pathname);
+    struct stat filedata;
+    fstat(fd, &filedata);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    readerStruct *reader = malloc(sizeof(readerStruct));
+    if(posix_memalign((void **)&reader->buffer, READER_BLOCK_ALIGN, READER_BLOCK_SIZE) != 0){
+        fprintf(stderr, "Error: Cannot allocate read buffer for file \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    reader->fd = fd;
+    reader->start = 0;
+    reader->end = 0;
+    reader->offset = 0;
+    reader->size = filedata.st_size;
+    reader->window = READER_BLOCK_SIZE;
+    return reader;
+}
+
+void readerClose(readerStruct *reader){
+    /**
+     * Close buffered reader and free its heap memory
+     * :param reader: Buffered reader
+     * :return: None
+     */
+    close(reader->fd);
+    free(reader->buffer);
+    free(reader);
+}
+
+int readerFill(readerStruct *reader){
+    /**
+     * Read next block from on-disk file into buffer
+     * The on-disk file offset is always reader->offset + reader->end
+     * Fills after a seek start at one aligned block, so reading a header
+     * past a skipped body does not read the next megabyte with it
+     * :param reader: Buffered reader
+     * :return: Unread bytes are available in buffer
+     */
+    reader->offset += reader->end;
+    reader->start -= reader->end;
+    reader->end = 0;
+    ssize_t bytesRead = read(reader->fd, reader->buffer, reader->window);
+    if(bytesRead > 0){
+        reader->end = bytesRead;
+    }
+    if(reader->window < READER_BLOCK_SIZE){ // Sequential again
+        reader->window *= 2;
+    }
+    return reader->start < reader->end;
+}
+
+size_t readerRead(readerStruct *reader, void *destination, size_t count){
+    /**
+     * Copy bytes from buffered reader
+     * Whole blocks are read straight into destination, bypassing the buffer
+     * :param reader: Buffered reader
+     * :param destination: Destination buffer
+     * :param count: Bytes to copy
+     * :return: Bytes copied, less than count at end of file
+     */
+    char *cur = destination;
+    size_t copied = 0;
+    while(copied < count){
+        if(reader->start >= reader->end){
+            size_t remaining = count-copied;
+            if(reader->start == reader->end && remaining >= READER_BLOCK_SIZE){ // Large read
+                reader->offset += reader->end;
+                reader->start = 0;
+                reader->end = 0;
+                ssize_t bytesRead = read(reader->fd, cur+copied, remaining-remaining%READER_BLOCK_SIZE);
+                if(bytesRead <= 0){
+                    break;
+                }
+                reader->offset += bytesRead;
+                copied += bytesRead;
+            }else if(!readerFill(reader)){
+                break;
+            }
+            continue;
+        }
+        size_t available = reader->end-reader->start;
+        if(available > count-copied){
+            available = count-copied;
+        }
+        memcpy(cur+copied, reader->buffer+reader->start, available);
+        reader->start += available;
+        copied += available;
+    }
+    return copied;
+}
+
+void readerSkip(readerStruct *reader, off_t count){
+    /**
+     * Advance buffered reader without copying
+     * Skips past the buffer seek to the enclosing aligned block and shrink
+     * the next fill to that block
+     * :param reader: Buffered reader
+     * :param count: Bytes to skip
+     * :return: None
+     */
+    if(reader->start <= reader->end && (size_t)count <= reader->end-reader->start){
+        reader->start += count;
+        return;
+    }
+    off_t target = readerOffset(reader)+count;
+    off_t aligned = target-target%READER_BLOCK_ALIGN;
+    lseek(reader->fd, aligned, SEEK_SET);
+    reader->offset = aligned;
+    reader->start = target-aligned;
+    reader->end = 0;
+    reader->window = READER_BLOCK_ALIGN;
+}
+
+int readerPeek(readerStruct *reader){
+    /**
+     * Next byte of buffered reader without consuming it
+     * :param reader: Buffered reader
+     * :return: Next byte, -1 at end of file
+     */
+    if(reader->start >= reader->end && !readerFill(reader)){
+        return -1;
+    }
+    return (unsigned char)reader->buffer[reader->start];
+}
+
+off_t readerOffset(readerStruct *reader){
+    /**
+     * On-disk file offset of next unread byte
+     * :param reader: Buffered reader
+     * :return: On-disk file offset
+     */
+    return reader->offset+reader->start;
+}
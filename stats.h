@@ -0,0 +1,324 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define STATS_OPEN 0
+#define STATS_PARSE 1
+#define STATS_MUTATE 2
+#define STATS_WRITE 3
+#define STATS_PHASES 4
+
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+
+/* --stats counters, printed to stderr at exit. `make stats` links myar
+   with --wrap for the system calls and allocator functions below, so every
+   call myar makes is counted without touching the call sites; calls made
+   inside the C library itself are not, so allocations are counted gross
+   and frees are not tracked. Other builds print phase times, members and
+   peak RSS only. Phases are switched by the main thread, and worker
+   threads count toward whichever phase it is in. */
+
+typedef struct statsPhase{
+    double wall; // seconds
+    double cpu; // process CPU seconds, all threads
+}statsPhaseStruct;
+
+typedef struct stats{
+    int format; // 0 while disabled, STATS_TEXT or STATS_JSON
+    atomic_ullong reads; // read and pread calls
+    atomic_ullong writes; // write, pwrite and writev calls
+    atomic_ullong seeks;
+    atomic_ullong copies; // copy_file_range and sendfile calls
+    atomic_ullong bytesRead;
+    atomic_ullong bytesWritten;
+    atomic_ullong bytesCopied;
+    atomic_ullong allocations; // successful malloc, calloc, realloc and posix_memalign calls
+    atomic_ullong allocatedBytes; // bytes requested by those calls, frees not subtracted
+    atomic_ullong members; // archived file headers parsed
+    int phase;
+    double wallStart; // phase start
+    double cpuStart;
+    statsPhaseStruct phases[STATS_PHASES];
+}statsStruct;
+
+
+statsStruct stats;
+char *statsPhaseNames[STATS_PHASES] = {"open", "parse", "mutate", "write"};
+
+
+void statsStart(int format);
+void statsPhase(int phase);
+void statsPrint(void);
+void statsCount(atomic_ullong *calls, atomic_ullong *bytes, ssize_t result);
+void statsAllocate(void *pointer, size_t size);
+void statsClock(double *wall, double *cpu);
+
+
+void statsStart(int format){
+    /**
+     * Enable counters and print them when the process exits
+     * :param format: STATS_TEXT or STATS_JSON
+     * :return: None
+     */
+    if(stats.format != 0){
+        stats.format = format;
+        return;
+    }
+    stats.format = format;
+    stats.phase = STATS_OPEN;
+    statsClock(&stats.wallStart, &stats.cpuStart);
+    atexit(statsPrint);
+}
+
+void statsPhase(int phase){
+    /**
+     * Charge time since the last switch to the current phase and enter phase
+     * :param phase: STATS_OPEN, STATS_PARSE, STATS_MUTATE or STATS_WRITE
+     * :return: None
+     */
+    if(stats.format == 0){
+        return;
+    }
+    double wall, cpu;
+    statsClock(&wall, &cpu);
+    stats.phases[stats.phase].wall += wall-stats.wallStart;
+    stats.phases[stats.phase].cpu += cpu-stats.cpuStart;
+    stats.wallStart = wall;
+    stats.cpuStart = cpu;
+    stats.phase = phase;
+}
+
+void statsPrint(void){
+    /**
+     * Print counters to stderr, exit handler registered by `statsStart`
+     * :return: None
+     */
+    statsPhase(stats.phase);
+    double wall = 0, cpu = 0;
+    for(int i=0; i < STATS_PHASES; i++){
+        wall += stats.phases[i].wall;
+        cpu += stats.phases[i].cpu;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    if(stats.format == STATS_JSON){
+        fprintf(stderr, "{");
+#ifdef STATS_WRAP
+        fprintf(stderr, "\"syscalls\":{\"read\":%llu,\"write\":%llu,\"lseek\":%llu,\"copy\":%llu},"
+                "\"bytes\":{\"read\":%llu,\"written\":%llu,\"copied\":%llu},"
+                "\"allocations\":{\"count\":%llu,\"bytes\":%llu},",
+                stats.reads, stats.writes, stats.seeks, stats.copies, stats.bytesRead, stats.bytesWritten, stats.bytesCopied,
+                stats.allocations, stats.allocatedBytes);
+#endif
+        fprintf(stderr, "\"peak_rss_kib\":%ld,\"members\":%llu,\"phases\":{", usage.ru_maxrss, stats.members);
+        for(int i=0; i < STATS_PHASES; i++){
+            fprintf(stderr, "%s\"%s\":{\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f}", i > 0 ? "," : "",
+                    statsPhaseNames[i], stats.phases[i].wall, stats.phases[i].cpu);
+        }
+        fprintf(stderr, "},\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f}\n", wall, cpu);
+        return;
+    }
+#ifdef STATS_WRAP
+    fprintf(stderr, "syscalls     read %llu, write %llu, lseek %llu, copy %llu\n", stats.reads, stats.writes, stats.seeks, stats.copies);
+    fprintf(stderr, "bytes        read %llu, written %llu, copied %llu\n", stats.bytesRead, stats.bytesWritten, stats.bytesCopied);
+    fprintf(stderr, "allocations  %llu, %llu bytes\n", stats.allocations, stats.allocatedBytes);
+#endif
+    fprintf(stderr, "peak rss     %ld KiB\n", usage.ru_maxrss);
+    fprintf(stderr, "members      %llu\n", stats.members);
+    fprintf(stderr, "%-12s %10s %10s\n", "phase", "wall s", "cpu s");
+    for(int i=0; i < STATS_PHASES; i++){
+        fprintf(stderr, "%-12s %10.6f %10.6f\n", statsPhaseNames[i], stats.phases[i].wall, stats.phases[i].cpu);
+    }
+    fprintf(stderr, "%-12s %10.6f %10.6f\n", "total", wall, cpu);
+}
+
+void statsCount(atomic_ullong *calls, atomic_ullong *bytes, ssize_t result){
+    /**
+     * Count system call and the bytes it moved
+     * :param calls: Call counter
+     * :param bytes: Byte counter, NULL if none
+     * :param result: System call result
+     * :return: None
+     */
+    if(stats.format == 0){
+        return;
+    }
+    atomic_fetch_add_explicit(calls, 1, memory_order_relaxed);
+    if(bytes != NULL && result > 0){
+        atomic_fetch_add_explicit(bytes, result, memory_order_relaxed);
+    }
+}
+
+void statsAllocate(void *pointer, size_t size){
+    /**
+     * Count successful allocation and the bytes it requested
+     * :param pointer: Allocated memory, NULL if the allocation failed
+     * :param size: Requested bytes
+     * :return: None
+     */
+    if(stats.format == 0 || pointer == NULL){
+        return;
+    }
+    atomic_fetch_add_explicit(&stats.allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats.allocatedBytes, size, memory_order_relaxed);
+}
+
+void statsClock(double *wall, double *cpu){
+    /**
+     * Read wall and process CPU clocks
+     * :param wall: Destination of monotonic seconds
+     * :param cpu: Destination of process CPU seconds
+     * :return: None
+     */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *wall = now.tv_sec+now.tv_nsec/1e9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    *cpu = now.tv_sec+now.tv_nsec/1e9;
+}
+
+
+#ifdef STATS_WRAP // Link time wrappers, see STATS_WRAP in the Makefile
+
+ssize_t __real_read(int fd, void *buffer, size_t count);
+ssize_t __real_pread64(int fd, void *buffer, size_t count, off_t offset);
+ssize_t __real_write(int fd, const void *buffer, size_t count);
+ssize_t __real_pwrite64(int fd, const void *buffer, size_t count, off_t offset);
+ssize_t __real_writev(int fd, const struct iovec *iov, int iovcnt);
+off_t __real_lseek64(int fd, off_t offset, int whence);
+ssize_t __real_copy_file_range(int in, off_t *inOffset, int out, off_t *outOffset, size_t count, unsigned flags);
+ssize_t __real_sendfile64(int out, int in, off_t *offset, size_t count);
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+int __real_posix_memalign(void **pointer, size_t alignment, size_t size);
+
+ssize_t __wrap_read(int fd, void *buffer, size_t count){
+    /**
+     * Counted `read`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_read(fd, buffer, count);
+    statsCount(&stats.reads, &stats.bytesRead, result);
+    return result;
+}
+
+ssize_t __wrap_pread64(int fd, void *buffer, size_t count, off_t offset){
+    /**
+     * Counted `pread`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_pread64(fd, buffer, count, offset);
+    statsCount(&stats.reads, &stats.bytesRead, result);
+    return result;
+}
+
+ssize_t __wrap_write(int fd, const void *buffer, size_t count){
+    /**
+     * Counted `write`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_write(fd, buffer, count);
+    statsCount(&stats.writes, &stats.bytesWritten, result);
+    return result;
+}
+
+ssize_t __wrap_pwrite64(int fd, const void *buffer, size_t count, off_t offset){
+    /**
+     * Counted `pwrite`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_pwrite64(fd, buffer, count, offset);
+    statsCount(&stats.writes, &stats.bytesWritten, result);
+    return result;
+}
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int iovcnt){
+    /**
+     * Counted `writev`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_writev(fd, iov, iovcnt);
+    statsCount(&stats.writes, &stats.bytesWritten, result);
+    return result;
+}
+
+off_t __wrap_lseek64(int fd, off_t offset, int whence){
+    /**
+     * Counted `lseek`
+     * :return: Result of the wrapped function
+     */
+    off_t result = __real_lseek64(fd, offset, whence);
+    statsCount(&stats.seeks, NULL, 0);
+    return result;
+}
+
+ssize_t __wrap_copy_file_range(int in, off_t *inOffset, int out, off_t *outOffset, size_t count, unsigned flags){
+    /**
+     * Counted `copy_file_range`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_copy_file_range(in, inOffset, out, outOffset, count, flags);
+    statsCount(&stats.copies, &stats.bytesCopied, result);
+    return result;
+}
+
+ssize_t __wrap_sendfile64(int out, int in, off_t *offset, size_t count){
+    /**
+     * Counted `sendfile`
+     * :return: Result of the wrapped function
+     */
+    ssize_t result = __real_sendfile64(out, in, offset, count);
+    statsCount(&stats.copies, &stats.bytesCopied, result);
+    return result;
+}
+
+void *__wrap_malloc(size_t size){
+    /**
+     * Counted `malloc`
+     * :return: Result of the wrapped function
+     */
+    void *pointer = __real_malloc(size);
+    statsAllocate(pointer, size);
+    return pointer;
+}
+
+void *__wrap_calloc(size_t count, size_t size){
+    /**
+     * Counted `calloc`
+     * :return: Result of the wrapped function
+     */
+    void *pointer = __real_calloc(count, size);
+    statsAllocate(pointer, count*size);
+    return pointer;
+}
+
+void *__wrap_realloc(void *pointer, size_t size){
+    /**
+     * Counted `realloc`, a failed call leaves the counters unchanged
+     * :return: Result of the wrapped function
+     */
+    void *result = __real_realloc(pointer, size);
+    statsAllocate(result, size);
+    return result;
+}
+
+int __wrap_posix_memalign(void **pointer, size_t alignment, size_t size){
+    /**
+     * Counted `posix_memalign`
+     * :return: Result of the wrapped function
+     */
+    int result = __real_posix_memalign(pointer, alignment, size);
+    statsAllocate(result == 0 ? *pointer : NULL, size);
+    return result;
+}
+#endif
@@ -0,0 +1,121 @@
+#!/bin/bash
+# Behaviour tests: round trips through myar for the cases that are easy to
+# break silently, each in its own scratch directory.
+#
+#     tests/behaviour.sh [myar]
+#
+# Prints one line per check and exits non-zero if any check failed.
+
+MYAR=$(realpath "${1:-./myar}")
+WORK=$(mktemp -d /tmp/myar-test.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+check(){
+    # check <description> <command...>: run command, report by exit status
+    local description=$1
+    shift
+    if "$@" >/dev/null 2>&1; then
+        echo "PASS $description"
+    else
+        echo "FAIL $description"
+        FAILED=1
+    fi
+}
+
+scratch(){
+    # scratch <name>: fresh scratch directory as current directory
+    mkdir -p "$WORK/$1" && cd "$WORK/$1" || exit 1
+}
+
+count(){
+    # count <archive> <name>: archived files of name
+    "$MYAR" -t "$1" | grep -cx "$2"
+}
+
+# -q/-x/-d with duplicate names: -x and -d take the first match (note 4)
+scratch duplicate
+echo first > dup
+"$MYAR" -q a.a dup
+echo second version > dup
+"$MYAR" -q a.a dup
+check "-q appends a duplicate name" test "$(count a.a dup)" = 2
+mkdir x && (cd x && "$MYAR" -x ../a.a dup)
+check "-x extracts the first duplicate" grep -qx first x/dup
+"$MYAR" -d a.a dup
+check "-d deletes only the first duplicate" test "$(count a.a dup)" = 1
+rm -f x/dup && (cd x && "$MYAR" -x ../a.a dup)
+check "-x after -d extracts the second duplicate" grep -qx "second version" x/dup
+
+# Catalog staleness: -q after -s leaves the catalog, readers scan past it
+scratch catalog
+for i in 1 2 3; do echo "file $i" > f$i; done
+"$MYAR" -q a.a f1 f2
+"$MYAR" -s a.a
+"$MYAR" -q a.a f3
+check "-t lists files appended after the catalog" test "$("$MYAR" -t a.a | tr '\n' ' ')" = "f1 f2 f3 "
+check "-t name finds a file appended after the catalog" test "$("$MYAR" -t a.a f3)" = f3
+mkdir x && (cd x && "$MYAR" -x ../a.a f3 f1)
+check "-x extracts past a stale catalog" cmp x/f3 f3
+"$MYAR" -d a.a f1
+check "-d rewrites the catalog to cover every file" test "$("$MYAR" -t a.a | tr '\n' ' ')" = "f2 f3 "
+if command -v ar >/dev/null; then
+    ar d a.a f2
+    check "GNU ar d makes the catalog stale, -t scans instead" test "$("$MYAR" -t a.a | tr '\n' ' ')" = "f3 "
+fi
+
+# -z vs plain members: only members marked compressed are decompressed
+scratch compress
+seq 1 20000 > text
+printf '\211MYARLZ\n%024d plain file shaped like a frame\n' 0 > lookalike
+"$MYAR" -z -q a.a text
+"$MYAR" -q a.a lookalike
+check "-z stores a compressible file smaller" test "$("$MYAR" -v a.a text | awk '{print $3}')" -lt "$(stat -c %s text)"
+mkdir x && (cd x && "$MYAR" -x ../a.a)
+check "-x decompresses a -z member" cmp x/text text
+check "-x leaves a plain file starting like a frame as is" cmp x/lookalike lookalike
+head -c 100000 /dev/urandom > noise
+"$MYAR" -z -q a.a noise
+check "-z keeps an incompressible file plain" test "$("$MYAR" -v a.a noise | awk '{print $3}')" = 100000
+rm -f x/noise && (cd x && "$MYAR" -x ../a.a noise)
+check "-x extracts an incompressible -z file" cmp x/noise noise
+
+# -u skips identical files and replaces changed ones, -i skips unchanged ones by stat
+scratch update
+echo same > u
+"$MYAR" -q a.a u
+"$MYAR" -u -q a.a u
+check "-u skips an identical file" test "$(count a.a u)" = 1
+echo changed > u
+"$MYAR" -u -q a.a u
+check "-u replaces a changed file" test "$(count a.a u)" = 1
+mkdir x && (cd x && "$MYAR" -x ../a.a u)
+check "-u keeps the changed content" grep -qx changed x/u
+"$MYAR" -s a.a
+"$MYAR" -u -q a.a u
+check "-u skips an identical file with a catalog" test "$(count a.a u)" = 1
+echo old > i
+touch -d "2001-01-01" i
+"$MYAR" -q a.a i
+"$MYAR" -i -q a.a i
+check "-i skips a file unchanged since archived" test "$(count a.a i)" = 1
+echo longer than before > i
+touch -d "2001-01-02" i
+"$MYAR" -i -q a.a i
+check "-i appends a changed file" test "$(count a.a i)" = 2
+
+# -A and -w never append the archive itself, under any name
+scratch self
+echo text > note
+echo text > a.a.txt
+"$MYAR" -q a.a note
+"$MYAR" -A ./a.a
+check "-A skips the archive" test "$(count a.a a.a)" = 0
+check "-A appends a file named like the archive" test "$(count a.a a.a.txt)" = 1
+(sleep 0.5; echo watched > watched) &
+"$MYAR" -w a.a 2 > watch.txt
+wait
+check "-w appends a modified file" test "$(count a.a watched)" = 1
+check "-w skips the archive it writes" test "$(count a.a a.a)" = 0
+
+exit $FAILED
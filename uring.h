@@ -0,0 +1,186 @@
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/* Minimal io_uring ring over the raw system calls, no liburing. One thread
+   prepares submission queue entries, submits them with one io_uring_enter
+   and reaps their completions. The ring is set up with a sparse table of
+   direct descriptors, so a linked chain can open a file into a known slot
+   and read, write and close it without the file descriptor ever reaching
+   user space. */
+
+typedef struct uring{
+    int fd;
+    unsigned entries;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned *sqArray;
+    unsigned sqQueued; // prepared entries not yet submitted
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+}uringStruct;
+
+
+uringStruct *uringOpen(unsigned entries, unsigned files);
+void uringClose(uringStruct *ring);
+struct io_uring_sqe *uringPrepare(uringStruct *ring, int opcode, int fd, const void *address, unsigned length, uint64_t offset, uint64_t data);
+int uringSubmit(uringStruct *ring);
+int uringComplete(uringStruct *ring, uint64_t *data, int *result);
+
+
+uringStruct *uringOpen(unsigned entries, unsigned files){
+    /**
+     * Set up io_uring ring with a sparse direct descriptor table
+     * :param entries: Submission queue entries, a power of 2
+     * :param files: Direct descriptor slots
+     * :return: Ring, NULL if the kernel or its policy does not allow one
+     */
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd == -1){
+        return NULL;
+    }
+    struct io_uring_rsrc_register table;
+    memset(&table, 0, sizeof(table));
+    table.nr = files;
+    table.flags = IORING_RSRC_REGISTER_SPARSE;
+    if(!(params.features & IORING_FEAT_NODROP) ||
+            syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES2, &table, sizeof(table)) == -1){ // Kernel before 5.19
+        close(fd);
+        return NULL;
+    }
+
+    // Map submission queue, completion queue and submission entries
+    uringStruct *ring = calloc(1, sizeof(uringStruct));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array+params.sq_entries*sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED){
+        uringClose(ring);
+        return NULL;
+    }
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqHead = (unsigned *)(sq+params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq+params.sq_off.tail);
+    ring->sqMask = *(unsigned *)(sq+params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq+params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq+params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq+params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(cq+params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq+params.cq_off.cqes);
+    return ring;
+}
+
+void uringClose(uringStruct *ring){
+    /**
+     * Unmap and close ring, free its heap memory
+     * :param ring: Ring
+     * :return: None
+     */
+    if(ring->sqRing != NULL && ring->sqRing != MAP_FAILED){
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if(ring->cqRing != NULL && ring->cqRing != MAP_FAILED){
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if(ring->sqes != NULL && ring->sqes != MAP_FAILED){
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+struct io_uring_sqe *uringPrepare(uringStruct *ring, int opcode, int fd, const void *address, unsigned length, uint64_t offset, uint64_t data){
+    /**
+     * Queue submission entry, submitted by the next `uringSubmit`
+     * The caller keeps prepared entries within the ring size
+     * :param ring: Ring
+     * :param opcode: IORING_OP_ operation
+     * :param fd: File descriptor, or direct descriptor slot with IOSQE_FIXED_FILE
+     * :param address: Buffer or pathname
+     * :param length: Buffer bytes, or mode for IORING_OP_OPENAT
+     * :param offset: File offset, or statx buffer for IORING_OP_STATX
+     * :param data: Caller value returned with the completion
+     * :return: Submission entry for flags not covered here
+     */
+    unsigned tail = *ring->sqTail+ring->sqQueued;
+    unsigned index = tail & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)address;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = data;
+    ring->sqArray[index] = index;
+    ring->sqQueued++;
+    return sqe;
+}
+
+int uringSubmit(uringStruct *ring){
+    /**
+     * Submit prepared entries and wait until all of them complete
+     * :param ring: Ring
+     * :return: Completions to reap with `uringComplete`, -1 on failure
+     */
+    unsigned count = ring->sqQueued;
+    __atomic_store_n(ring->sqTail, *ring->sqTail+count, __ATOMIC_RELEASE);
+    ring->sqQueued = 0;
+    unsigned submitted = 0;
+    while(submitted < count){
+        int result = syscall(__NR_io_uring_enter, ring->fd, count-submitted, count, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(result == -1 && errno == EINTR){
+            continue;
+        }else if(result <= 0){
+            return -1;
+        }
+        submitted += result;
+    }
+    while(__atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)-*ring->cqHead < count){ // Interrupted wait
+        if(syscall(__NR_io_uring_enter, ring->fd, 0, count, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR){
+            return -1;
+        }
+    }
+    return count;
+}
+
+int uringComplete(uringStruct *ring, uint64_t *data, int *result){
+    /**
+     * Reap one completion
+     * :param ring: Ring
+     * :param data: Destination of the caller value given to `uringPrepare`
+     * :param result: Destination of the operation result, -errno on failure
+     * :return: A completion was reaped
+     */
+    unsigned head = *ring->cqHead;
+    if(head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)){
+        return 0;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+    *data = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cqHead, head+1, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define WATCH_DEBOUNCE_MS 100 // quiet time before a modified file is taken
+#define WATCH_MAX_DELAY_MS 1000 // longest a busy file waits before it is taken
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO)
+#define WATCH_BUFFER_SIZE (64*(sizeof(struct inotify_event)+NAME_MAX+1))
+
+
+typedef struct watchPending{
+    char *pathname;
+    long first; // monotonic ms of first event since last taken
+    long deadline; // monotonic ms the file may be taken
+}watchPendingStruct;
+
+typedef struct watch{
+    int fd; // inotify file descriptor
+    char *buffer; // inotify event buffer
+    watchPendingStruct *pending; // modified files in first event order
+    size_t count;
+    size_t capacity;
+    char *ignored; // file name whose events are dropped, NULL if none
+}watchStruct;
+
+
+watchStruct *watchOpen(char *pathname);
+void watchClose(watchStruct *watch);
+void watchIgnore(watchStruct *watch, char *pathname);
+long watchNow(void);
+void watchTouch(watchStruct *watch, char *pathname, long now);
+int watchTimeout(watchStruct *watch, long now, long end);
+void watchWait(watchStruct *watch, int timeout);
+char *watchTakeDue(watchStruct *watch, long now);
+
+
+watchStruct *watchOpen(char *pathname){
+    /**
+     * Watch on-disk directory for modified files
+     * :param pathname: On-disk directory path
+     * :return: Directory watch
+     */
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd == -1 || inotify_add_watch(fd, pathname, WATCH_EVENTS) == -1){ // Error handling
+        fprintf(stderr, "Error: Cannot watch directory \"%s\"\n", pathname);
+        exit(EXIT_FAILURE);
+    }
+    watchStruct *watch = malloc(sizeof(watchStruct));
+    watch->fd = fd;
+    watch->buffer = malloc(WATCH_BUFFER_SIZE);
+    watch->count = 0;
+    watch->capacity = 16;
+    watch->pending = malloc(watch->capacity*sizeof(watchPendingStruct));
+    watch->ignored = NULL;
+    return watch;
+}
+
+void watchClose(watchStruct *watch){
+    /**
+     * Stop directory watch and free its heap memory
+     * :param watch: Directory watch
+     * :return: None
+     */
+    for(size_t i=0; i < watch->count; i++){
+        free(watch->pending[i].pathname);
+    }
+    close(watch->fd);
+    free(watch->ignored);
+    free(watch->pending);
+    free(watch->buffer);
+    free(watch);
+}
+
+void watchIgnore(watchStruct *watch, char *pathname){
+    /**
+     * Drop events of one file in the watched directory
+     * :param watch: Directory watch
+     * :param pathname: File name in the watched directory
+     * :return: None
+     */
+    free(watch->ignored);
+    watch->ignored = strdup(pathname);
+}
+
+long watchNow(void){
+    /**
+     * Monotonic clock in milliseconds
+     * :return: Milliseconds
+     */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000L+now.tv_nsec/1000000L;
+}
+
+void watchTouch(watchStruct *watch, char *pathname, long now){
+    /**
+     * Record modification, pushing back the file's deadline
+     * A file written continuously is still taken every WATCH_MAX_DELAY_MS
+     * :param watch: Directory watch
+     * :param pathname: Modified on-disk file path
+     * :param now: Monotonic ms of modification
+     * :return: None
+     */
+    watchPendingStruct *pending = NULL;
+    for(size_t i=0; i < watch->count; i++){
+        if(strcmp(watch->pending[i].pathname, pathname) == 0){
+            pending = &watch->pending[i];
+            break;
+        }
+    }
+    if(pending == NULL){
+        if(watch->count == watch->capacity){
+            watch->capacity *= 2;
+            watch->pending = realloc(watch->pending, watch->capacity*sizeof(watchPendingStruct));
+        }
+        pending = &watch->pending[watch->count++];
+        pending->pathname = strdup(pathname);
+        pending->first = now;
+    }
+    pending->deadline = now+WATCH_DEBOUNCE_MS;
+    if(pending->deadline > pending->first+WATCH_MAX_DELAY_MS){
+        pending->deadline = pending->first+WATCH_MAX_DELAY_MS;
+    }
+}
+
+int watchTimeout(watchStruct *watch, long now, long end){
+    /**
+     * Milliseconds to wait for events before a file is due or the watch ends
+     * :param watch: Directory watch
+     * :param now: Monotonic ms
+     * :param end: Monotonic ms the watch ends
+     * :return: Poll timeout in milliseconds
+     */
+    long wake = end;
+    for(size_t i=0; i < watch->count; i++){
+        if(watch->pending[i].deadline < wake){
+            wake = watch->pending[i].deadline;
+        }
+    }
+    if(wake <= now){
+        return 0;
+    }
+    return wake-now > INT_MAX ? INT_MAX : (int)(wake-now);
+}
+
+void watchWait(watchStruct *watch, int timeout){
+    /**
+     * Block until events arrive or timeout expires, then record them
+     * Directory events and events of the ignored file are dropped
+     * :param watch: Directory watch
+     * :param timeout: Poll timeout in milliseconds
+     * :return: None
+     */
+    struct pollfd descriptor = {.fd = watch->fd, .events = POLLIN};
+    if(poll(&descriptor, 1, timeout) <= 0){
+        return;
+    }
+    long now = watchNow();
+    ssize_t bytesRead;
+    while((bytesRead = read(watch->fd, watch->buffer, WATCH_BUFFER_SIZE)) > 0){
+        char *cur = watch->buffer;
+        while(cur < watch->buffer+bytesRead){
+            struct inotify_event *event = (struct inotify_event *)cur;
+            if(event->len > 0 && !(event->mask & IN_ISDIR) && (watch->ignored == NULL || strcmp(event->name, watch->ignored) != 0)){
+                watchTouch(watch, event->name, now);
+            }
+            cur += sizeof(struct inotify_event)+event->len;
+        }
+    }
+    if(bytesRead == -1 && errno != EAGAIN && errno != EINTR){ // Error handling
+        fprintf(stderr, "Error: Cannot read directory watch events\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+char *watchTakeDue(watchStruct *watch, long now){
+    /**
+     * Remove the first modified file whose deadline has passed
+     * :param watch: Directory watch
+     * :param now: Monotonic ms
+     * :return: Heap allocated on-disk file path, NULL if none is due
+     */
+    for(size_t i=0; i < watch->count; i++){
+        if(watch->pending[i].deadline <= now){
+            char *pathname = watch->pending[i].pathname;
+            memmove(&watch->pending[i], &watch->pending[i+1], (watch->count-i-1)*sizeof(watchPendingStruct));
+            watch->count--;
+            return pathname;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+#define WRITER_IOV_COUNT 1024
+#define WRITER_BUFFER_SIZE (1 << 20)
+#define WRITER_COALESCE_SIZE 4096
+#define WRITER_COPY_BLOCK_SIZE (1 << 30) // largest in-kernel copy per call
+#define WRITER_COPY_RANGE 0 // copy_file_range, may reflink
+#define WRITER_COPY_SENDFILE 1
+#define WRITER_COPY_BUFFER 2
+
+
+typedef struct writer{
+    int fd;
+    char *pathname; // reported on a failed write before exiting, NULL to record it in error instead
+    int error; // errno of the first failed write without pathname, 0 if none
+    struct iovec iov[WRITER_IOV_COUNT];
+    int iovCount;
+    char *buffer; // coalesced copies of small writes
+    size_t used; // bytes used in buffer
+}writerStruct;
+
+
+writerStruct *writerOpen(int fd, char *pathname);
+int writerClose(writerStruct *writer);
+void writerWrite(writerStruct *writer, void *source, size_t count);
+void writerFlush(writerStruct *writer);
+off_t writerCopy(writerStruct *writer, int fd, off_t offset, off_t count);
+
+
+writerStruct *writerOpen(int fd, char *pathname){
+    /**
+     * Gathered writer over open file descriptor
+     * :param fd: On-disk file open file descriptor
+     * :param pathname: On-disk file path for error reporting, NULL to
+     * record a failed write in error and drop later writes instead of exiting
+     * :return: Gathered writer
+     */
+    writerStruct *writer = malloc(sizeof(writerStruct));
+    writer->fd = fd;
+    writer->pathname = pathname;
+    writer->error = 0;
+    writer->iovCount = 0;
+    writer->buffer = malloc(WRITER_BUFFER_SIZE);
+    writer->used = 0;
+    return writer;
+}
+
+int writerClose(writerStruct *writer){
+    /**
+     * Flush gathered writer and free its heap memory
+     * The file descriptor is left open
+     * :param writer: Gathered writer
+     * :return: errno of the first failed write without pathname, 0 if none
+     */
+    writerFlush(writer);
+    int error = writer->error;
+    free(writer->buffer);
+    free(writer);
+    return error;
+}
+
+void writerWrite(writerStruct *writer, void *source, size_t count){
+    /**
+     * Queue bytes on gathered writer
+     * Small writes are copied into the coalescing buffer, larger ones are
+     * referenced in place and must stay valid until the next flush
+     * :param writer: Gathered writer
+     * :param source: Source buffer
+     * :param count: Bytes to write
+     * :return: None
+     */
+    if(count == 0){
+        return;
+    }
+    int isSmall = count < WRITER_COALESCE_SIZE;
+    if(writer->iovCount == WRITER_IOV_COUNT || (isSmall && writer->used+count > WRITER_BUFFER_SIZE)){
+        writerFlush(writer);
+    }
+
+    if(isSmall){
+        char *destination = writer->buffer+writer->used;
+        memcpy(destination, source, count);
+        writer->used += count;
+        if(writer->iovCount > 0){
+            struct iovec *last = &writer->iov[writer->iovCount-1];
+            if((char *)last->iov_base+last->iov_len == destination){ // Extend previous copy
+                last->iov_len += count;
+                return;
+            }
+        }
+        source = destination;
+    }
+    writer->iov[writer->iovCount].iov_base = source;
+    writer->iov[writer->iovCount].iov_len = count;
+    writer->iovCount++;
+}
+
+void writerFlush(writerStruct *writer){
+    /**
+     * Write queued bytes to on-disk file, resuming after short writes
+     * :param writer: Gathered writer
+     * :return: None
+     */
+    struct iovec *cur = writer->iov;
+    int remaining = writer->error == 0 ? writer->iovCount : 0; // after a recorded failure writes are dropped
+    while(remaining > 0){
+        ssize_t bytesWritten = writev(writer->fd, cur, remaining);
+        if(bytesWritten == -1 && errno == EINTR){
+            continue;
+        }else if(bytesWritten <= 0 && writer->pathname == NULL){ // Caller checks error
+            writer->error = bytesWritten == -1 ? errno : EIO;
+            break;
+        }else if(bytesWritten <= 0){
+            fprintf(stderr, "Error: Cannot write to file \"%s\"\n", writer->pathname);
+            exit(EXIT_FAILURE);
+        }
+        while(remaining > 0 && (size_t)bytesWritten >= cur->iov_len){
+            bytesWritten -= cur->iov_len;
+            cur++;
+            remaining--;
+        }
+        if(remaining > 0){ // Short write inside an iovec
+            cur->iov_base = (char *)cur->iov_base+bytesWritten;
+            cur->iov_len -= bytesWritten;
+        }
+    }
+    writer->iovCount = 0;
+    writer->used = 0;
+}
+
+off_t writerCopy(writerStruct *writer, int fd, off_t offset, off_t count){
+    /**
+     * Copy file range to gathered writer without a user space copy if possible
+     * Queued bytes are flushed first. The range is copied in-kernel with
+     * copy_file_range, then sendfile, and where neither applies (e.g. an
+     * O_APPEND writer) through the coalescing buffer one block at a time
+     * :param writer: Gathered writer
+     * :param fd: Source open file descriptor
+     * :param offset: Source file offset
+     * :param count: Bytes to copy
+     * :return: Bytes copied, less than count at end of source file or after a recorded failure
+     */
+    writerFlush(writer);
+    int engine = WRITER_COPY_RANGE;
+    off_t copied = 0;
+    while(copied < count && writer->error == 0){
+        off_t remaining = count-copied;
+        ssize_t bytesCopied;
+        if(engine == WRITER_COPY_RANGE){
+            loff_t in = offset+copied;
+            bytesCopied = copy_file_range(fd, &in, writer->fd, NULL, remaining < WRITER_COPY_BLOCK_SIZE ? remaining : WRITER_COPY_BLOCK_SIZE, 0);
+        }else if(engine == WRITER_COPY_SENDFILE){
+            off_t in = offset+copied;
+            bytesCopied = sendfile(writer->fd, fd, &in, remaining < WRITER_COPY_BLOCK_SIZE ? remaining : WRITER_COPY_BLOCK_SIZE);
+        }else{
+            bytesCopied = pread(fd, writer->buffer, remaining < WRITER_BUFFER_SIZE ? remaining : WRITER_BUFFER_SIZE, offset+copied);
+            if(bytesCopied > 0){
+                writer->iov[0].iov_base = writer->buffer;
+                writer->iov[0].iov_len = bytesCopied;
+                writer->iovCount = 1;
+                writerFlush(writer);
+                if(writer->error != 0){
+                    break;
+                }
+            }
+        }
+        if(bytesCopied == -1 && errno == EINTR){
+            continue;
+        }else if(bytesCopied == -1 && engine != WRITER_COPY_BUFFER){ // Unsupported, fall back
+            engine++;
+            continue;
+        }else if(bytesCopied <= 0){
+            break;
+        }
+        copied += bytesCopied;
+    }
+    return copied;
+}